@@ -5,17 +5,35 @@
 #include <boost/asio.hpp>
 #include <chrono>
 #include <atomic>
+#include <map>
+#include <sstream>
+#include <fstream>
+#include <poll.h>
+#include <unistd.h>
+#include <random>
+#include <csignal>
+#include <cstring>
+#include "clientSession.hpp"
 
 //By Robert Britton
 
+//./client [--session <id>] <manager ip>[:<base port>][,<manager ip>[:<base port>]...] <exe> ...
+//./client [--session <id>] <manager ip>[:<base port>] --dag <pipeline file>
+//./client [--session <id>] <manager ip>[:<base port>] --sweep "<exe> --x {0..9999} --mode {a,b,c}"
+//./client <manager ip>[:<base port>][,...] --stats
+//  a sweep runs every combination of its {from..to[..step]} and {x,y,z} values, each result starts with the point's index
+//  pipeline file lines are "<name> [after <name> <name> ...]: <command>", a job starts once every job it is after has finished
 //time ./client 127.0.0.1 ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test ./t1_test
 
-// g++ -std=c++20 -I. -pthread processServer.cxx runEXE/runEXE.cxx -lcurl -o processServe
+// g++ -std=c++20 -I. -pthread client.cxx clientSession.cxx -o client
 uint16_t ServerPort = 9000;
 uint16_t WaitPort = 9001;
 
-std::atomic<bool> timeOut = true;
+constexpr int managerAttempts = 3;//sends to one manager, after 1, 2 and 4 s without an answer, before failing over
 boost::asio::io_context io;
+int cancelFd = -1;//where Ctrl-C sends CANCEL from, the manager knows the client by this socket's port
+sockaddr_storage cancelAddress;
+socklen_t cancelLength = 0;
 
 boost::asio::ip::udp::socket findOpenPort(uint16_t port) {//recursively finds open port
     try{
@@ -31,38 +49,156 @@ boost::asio::ip::udp::socket findOpenPort(uint16_t port) {//recursively finds op
     }
 }
 
-void TimOutTimer(){//time out thread
-    std::this_thread::sleep_for(std::chrono::seconds(5));
-    if(timeOut.load()){
-        std::cout << "Timeout Occurred" << std::endl;
+bool waitForReply(boost::asio::ip::udp::socket& sock, int milliseconds){//true once a datagram is ready to read
+    pollfd descriptor = {sock.native_handle(), POLLIN, 0};
+    return poll(&descriptor, 1, milliseconds) > 0;
+}
+
+int readPipeline(std::string fileName, std::string& exeCMD){//turns a pipeline file into DAG lines, returns the number of jobs
+    std::ifstream file(fileName);
+    if(!file.is_open()){
+        std::cerr << "File " << fileName << " could not be opened" << std::endl;
         exit(1);
     }
+    int jobs = 0;
+    std::string line;
+    while(std::getline(file, line)){
+        if(line.empty() || line[0] == '#' || line.find(':') == std::string::npos)continue;
+        std::istringstream header(line.substr(0, line.find(':')));
+        std::string command = line.substr(line.find(':') + 1);
+        command.erase(0, command.find_first_not_of(' '));
+        std::string name, word, dependencies;
+        header >> name;
+        while(header >> word){
+            if(word == "after")continue;
+            dependencies += (dependencies.empty() ? "" : ",") + word;
+        }
+        exeCMD += "DAG " + name + " " + (dependencies.empty() ? "-" : dependencies) + " " + command + '\n';
+        jobs++;
+    }
+    return jobs;
+}
+
+void cancelOnInterrupt(int){//the manager drops this client's queued jobs and kills its running ones
+    if(cancelLength > 0)sendto(cancelFd, "CANCEL", 6, 0, (sockaddr*)&cancelAddress, cancelLength);
+    _exit(130);
+}
+
+bool stripSubmissionID(std::string& reply, const std::string& trailer){//replies to a submission end in its id, true if this one did
+    if(reply.size() < trailer.size() || reply.compare(reply.size() - trailer.size(), trailer.size(), trailer) != 0)return false;
+    reply.erase(reply.size() - trailer.size());
+    return true;
 }
 
 int main(int argc, char* argv[]) {
     std::string exeCMD;
-    if(argc < 3) { std::cerr << "usage: peer_a <peer‑ip> <exe>\n"; return 1; }
-    for(int i = 2; i < argc; i++) {
+    std::string session = boost::asio::ip::host_name() + ":" + std::to_string(getpid());
+    int first = 1;
+    if(argc > 2 && std::string(argv[1]) == "--session"){
+        session = argv[2];
+        first = 3;
+    }
+    if(argc < first + 2) { std::cerr << "usage: peer_a [--session <id>] <peer‑ip>[:<base port>][,...] <exe>\n"; return 1; }
+    HashRing managers;//sharded managers, the session always lands on the same one while it is up
+    std::istringstream managerList(argv[first]);
+    std::string manager;
+    while(std::getline(managerList, manager, ','))managers.add(manager);
+    if(std::string(argv[first + 1]) == "--stats"){//what finished jobs cost by executable and by client host, from every manager listed
+        boost::asio::ip::udp::socket statsSocket(io, {boost::asio::ip::udp::v4(), 0});
+        std::istringstream statsList(argv[first]);
+        std::vector<char> reply(65536);
+        while(std::getline(statsList, manager, ',')){
+            std::string managerIP = manager;
+            uint16_t port = 9000;
+            if(managerIP.find(':') != std::string::npos){
+                port = std::stoi(managerIP.substr(managerIP.find(':') + 1));
+                managerIP = managerIP.substr(0, managerIP.find(':'));
+            }
+            statsSocket.send_to(boost::asio::buffer(std::string("STATS")), boost::asio::ip::udp::endpoint(boost::asio::ip::make_address(managerIP), port));
+            if(!waitForReply(statsSocket, 1000)){
+                std::cerr << manager << " did not answer" << std::endl;
+                continue;
+            }
+            auto n = statsSocket.receive(boost::asio::buffer(reply));
+            std::cout << "== " << manager << "\n" << std::string_view(reply.data(), n);
+        }
+        return 0;
+    }
+    size_t jobCount = 0;
+    for(int i = first + 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if(arg == "--dag" && i + 1 < argc){
+            jobCount += readPipeline(argv[++i], exeCMD);
+            continue;
+        }
+        if(arg == "--sweep" && i + 1 < argc){//expanded by the manager, the number of points comes back with the reply
+            exeCMD += "SWEEP " + std::string(argv[++i]) + '\n';
+            continue;
+        }
         exeCMD += argv[i];
         exeCMD += '\n';
+        jobCount++;
     }
-    boost::asio::ip::udp::endpoint serverEndPoint(boost::asio::ip::make_address(argv[1]), ServerPort);
-    boost::asio::ip::udp::endpoint serverWaitPoint(boost::asio::ip::make_address(argv[1]), WaitPort);
 
+    std::string submissionID = session + "." + std::to_string(getpid()) + "." + std::to_string(std::random_device{}());//the same across resends, so a manager never queues it twice
+    std::string trailer = "\nSUBMISSION " + submissionID;
+    exeCMD = "SUBMISSION " + submissionID + "\n" + exeCMD;
     std::string result;
-    std::array<char, 1024> buf;
+    std::vector<char> buf(65536);//results from the memfd path are far bigger than 1024 bytes
 
     boost::asio::ip::udp::socket sock = findOpenPort(1);
-    sock.send_to(boost::asio::buffer(exeCMD), serverEndPoint);
-    std::thread timerThread(TimOutTimer);//Process Server has 5 seconds to send the initialization message or timeout occurs
-    timerThread.detach();
-    sock.receive_from(boost::asio::buffer(buf), serverEndPoint);//receives back from load mananger to assure connection
-    timeOut.store(false);//stops timeout
+    boost::asio::ip::udp::endpoint serverEndPoint;
+    boost::asio::ip::udp::endpoint serverWaitPoint;
+    std::string reply;
+    std::mt19937 jitter(std::random_device{}());
+    for(int retries = 0;; retries++){//an overloaded manager answers RETRY-AFTER <ms> instead of accepting the jobs
+        bool answered = false;
+        for(std::string managerAddress : managers.lookup(session)){//next manager on the ring takes over if the owner does not answer
+            std::string managerIP = managerAddress;
+            if(managerIP.find(':') != std::string::npos){//manager running on a non default base port
+                ServerPort = std::stoi(managerIP.substr(managerIP.find(':') + 1));
+                WaitPort = ServerPort + 1;
+                managerIP = managerIP.substr(0, managerIP.find(':'));
+            }
+            serverEndPoint = boost::asio::ip::udp::endpoint(boost::asio::ip::make_address(managerIP), ServerPort);
+            serverWaitPoint = boost::asio::ip::udp::endpoint(boost::asio::ip::make_address(managerIP), WaitPort);
+            for(int attempts = 0; attempts < managerAttempts && !answered; attempts++){//a manager that is only slow, e.g. syncing its journal, drops the resend
+                sock.send_to(boost::asio::buffer(exeCMD), serverEndPoint);
+                answered = waitForReply(sock, 1000 << attempts);
+            }
+            if(answered)break;
+        }
+        if(!answered){
+            std::cout << "Timeout Occurred" << std::endl;
+            return 1;
+        }
+        auto n = sock.receive_from(boost::asio::buffer(buf), serverEndPoint);//receives back from load mananger to assure connection
+        reply = std::string(std::string_view(buf.data(), n));
+        stripSubmissionID(reply, trailer);
+        if(reply.rfind("RETRY-AFTER ", 0) != 0)break;
+        long long wait = std::min(std::stoll(reply.substr(12)) << std::min(retries, 4), 60000LL);//backs off further if the manager keeps refusing
+        wait = wait * std::uniform_real_distribution<double>(0.5, 1.5)(jitter);//spreads out clients that were refused together
+        std::cerr << "Manager busy, retrying in " << wait << "ms" << std::endl;
+        std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+    }
+    if(reply.rfind("Client Initialized", 0) != 0){//e.g. a DAG with a cycle
+        std::cerr << reply << std::endl;
+        return 1;
+    }
+    std::istringstream(reply.substr(18)) >> jobCount;//"Client Initialized <number of results>"
+    cancelFd = sock.native_handle();
+    memcpy(&cancelAddress, serverEndPoint.data(), serverEndPoint.size());
+    cancelLength = serverEndPoint.size();
+    signal(SIGINT, cancelOnInterrupt);
 
-    for(int i = 2; i < argc; i++){
+    for(size_t i = 0; i < jobCount; i++){
         auto n = sock.receive_from(boost::asio::buffer(buf), serverEndPoint);
-
-        std::cout<<std::string(std::string_view(buf.data(), n))<< std::endl;
+        std::string output(buf.data(), n);
+        if(stripSubmissionID(output, trailer)){//a second answer to a resend, not a result
+            i--;
+            continue;
+        }
+        std::cout<<output<< std::endl;
         sock.send_to(boost::asio::buffer("NEXT RESULT"), serverWaitPoint);
     }   
     return 0;
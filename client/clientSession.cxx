@@ -0,0 +1,259 @@
+#include <iostream>
+#include <unistd.h>
+#include "clientSession.hpp"
+
+//by Robert Britton
+
+uint64_t hashKey(const std::string& key){//FNV-1a with a final mix so similar addresses still spread around the ring
+    uint64_t hash = 1469598103934665603ULL;
+    for(unsigned char c : key){
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+Session::Session(boost::asio::io_context& io, const std::string& managerList, std::string key):
+strand(boost::asio::make_strand(io)), socket(strand, {boost::asio::ip::udp::v4(), 0}), replyTimer(strand), buf(65536) {
+    if(key.empty())key = boost::asio::ip::host_name() + ":" + std::to_string(getpid());
+    HashRing ring;//sharded managers, the session always lands on the same one while it is up
+    std::istringstream list(managerList);
+    std::string manager;
+    while(std::getline(list, manager, ','))ring.add(manager);
+    for(std::string managerAddress : ring.lookup(key)){
+        uint16_t port = 9000;
+        if(managerAddress.find(':') != std::string::npos){//manager running on a non default base port
+            port = std::stoi(managerAddress.substr(managerAddress.find(':') + 1));
+            managerAddress = managerAddress.substr(0, managerAddress.find(':'));
+        }
+        managers.push_back({boost::asio::ip::make_address(managerAddress), port});
+    }
+    std::ostringstream nonce;
+    nonce << std::hex << std::random_device{}() << std::random_device{}();
+    sessionID = nonce.str();
+    boost::asio::post(strand, [this]{ receive(); });
+}
+
+Session::~Session(){
+    boost::system::error_code error;
+    socket.close(error);
+}
+
+void deliver(Session::Handler handler, JobResult result){//runs the completion on the executor it is bound to, the strand is never held by user code
+    boost::asio::get_associated_cancellation_slot(handler).clear();
+    boost::asio::dispatch(boost::asio::append(std::move(handler), std::move(result)));
+}
+
+void Session::start(std::string tag, std::string command, Handler handler){
+    boost::asio::post(strand, [this, tag = std::move(tag), command = std::move(command), handler = std::move(handler)]() mutable {
+        std::string error;
+        if(closed)error = "session closed";
+        else if(tag.empty() || tag.find_first_of(" \t\n") != std::string::npos)error = "tag must be a single word";
+        else if(jobs.count(tag))error = "tag " + tag + " is still in use";
+        else if(command.empty() || command.find('\n') != std::string::npos)error = "command must be a single line";
+        else if(tag.size() + command.size() + 6 + maxHeader > maxSubmission)error = "command longer than a submission datagram";
+        if(!error.empty()){
+            deliver(std::move(handler), {JobResult::Rejected, tag, command, error});
+            return;
+        }
+        jobCount++;
+        jobs.emplace(tag, Job{command, std::move(handler), std::nullopt});
+        unsent.push_back(tag);
+        if(!flushing){//everything submitted before the strand gets back to this shares datagrams
+            flushing = true;
+            boost::asio::post(strand, [this]{ flush(); });
+        }
+    });
+}
+
+void Session::complete(const std::string& tag, JobResult::Status status, std::string output){
+    auto job = jobs.find(tag);
+    if(job == jobs.end())return;//already cancelled
+    JobResult result{status, tag, std::move(job->second.command), std::move(output)};
+    Handler handler = std::move(job->second.handler);
+    jobs.erase(job);
+    jobCount--;
+    deliver(std::move(handler), std::move(result));
+}
+
+void Session::cancel(const std::string& tag){
+    boost::asio::post(strand, [this, tag]{
+        if(!jobs.count(tag))return;
+        auto waiting = std::find(unsent.begin(), unsent.end(), tag);
+        if(waiting != unsent.end())unsent.erase(waiting);
+        std::optional<size_t> manager = jobs[tag].manager;
+        if(manager){
+            cancels[*manager] += " " + tag;
+            if(!cancelling){//cancels made together share a datagram
+                cancelling = true;
+                boost::asio::post(strand, [this]{ flushCancels(); });
+            }
+        }
+        complete(tag, JobResult::Cancelled, "");
+    });
+}
+
+void Session::close(){
+    boost::asio::post(strand, [this]{
+        closed = true;
+        std::vector<std::string> tags;
+        for(auto& [tag, job] : jobs)tags.push_back(tag);
+        for(std::string& tag : tags)complete(tag, JobResult::Cancelled, "session closed");
+        unsent.clear();
+        awaiting.clear();
+        replyTimer.cancel();
+        boost::system::error_code error;
+        socket.close(error);
+    });
+}
+
+Session::Submission Session::newSubmission(){
+    Submission submission;
+    submission.id = sessionID + "." + std::to_string(submissionCounter++);
+    submission.text = "SUBMISSION " + submission.id + "\n";
+    return submission;
+}
+
+void Session::flush(){//packs every unsent job into as few submissions as fit
+    flushing = false;
+    Submission submission = newSubmission();
+    for(std::string& tag : unsent){
+        std::string line = "TAG " + tag + " " + jobs[tag].command + "\n";
+        if(submission.text.size() + line.size() > maxSubmission){
+            send(std::move(submission));
+            submission = newSubmission();
+        }
+        submission.text += line;
+        submission.tags.push_back(tag);
+    }
+    unsent.clear();
+    if(!submission.tags.empty())send(std::move(submission));
+}
+
+void Session::flushCancels(){
+    cancelling = false;
+    boost::system::error_code error;
+    for(auto& [manager, tags] : cancels){
+        for(size_t start = 0; start < tags.size();){//split on a tag boundary below the submission size
+            size_t end = start + maxSubmission >= tags.size() ? tags.size() : tags.rfind(' ', start + maxSubmission);
+            socket.send_to(boost::asio::buffer("CANCEL" + tags.substr(start, end - start)), managers[manager], 0, error);
+            start = end;
+        }
+    }
+    cancels.clear();
+}
+
+void Session::send(Submission submission){
+    if(closed)return;
+    for(std::string& tag : submission.tags){
+        auto job = jobs.find(tag);
+        if(job != jobs.end())job->second.manager = submission.manager;
+    }
+    boost::system::error_code error;
+    socket.send_to(boost::asio::buffer(submission.text), managers[submission.manager], 0, error);
+    submission.attempts++;
+    submission.sentAt = std::chrono::steady_clock::now();
+    awaiting.push_back(std::move(submission));
+    if(!timing){
+        timing = true;
+        replyTimer.expires_after(replyTimeout / 4);
+        replyTimer.async_wait([this](const boost::system::error_code& error){
+            timing = false;
+            if(!error)checkReplies();
+        });
+    }
+}
+
+void Session::checkReplies(){//a submission nobody answered is resent with backoff, then goes to the next manager on the ring
+    auto now = std::chrono::steady_clock::now();
+    std::vector<Submission> late;
+    for(auto it = awaiting.begin(); it != awaiting.end();){
+        if(now - it->sentAt < replyTimeout * (1 << (it->attempts - 1))){
+            it++;
+            continue;
+        }
+        late.push_back(std::move(*it));
+        it = awaiting.erase(it);
+    }
+    for(Submission& submission : late){
+        if(submission.attempts < managerAttempts){//the manager may only be slow, e.g. syncing its journal, and drops the resend if it has the first
+            send(std::move(submission));
+            continue;
+        }
+        if(++submission.tries >= managers.size()){
+            for(std::string& tag : submission.tags){
+                complete(tag, JobResult::Rejected, "no manager answered");
+            }
+            continue;
+        }
+        submission.manager = (submission.manager + 1) % managers.size();
+        submission.attempts = 0;
+        send(std::move(submission));
+    }
+    if(!awaiting.empty() && !timing){
+        timing = true;
+        replyTimer.expires_after(replyTimeout / 4);
+        replyTimer.async_wait([this](const boost::system::error_code& error){
+            timing = false;
+            if(!error)checkReplies();
+        });
+    }
+}
+
+void Session::receive(){
+    socket.async_receive_from(boost::asio::buffer(buf), sender, [this](const boost::system::error_code& error, size_t n){
+        if(error == boost::asio::error::operation_aborted || closed)return;
+        if(!error){
+            std::string message(buf.data(), n);
+            if(message.rfind("#", 0) == 0)result(message, sender);
+            else reply(message, sender);
+        }
+        receive();
+    });
+}
+
+void Session::reply(const std::string& received, const boost::asio::ip::udp::endpoint& from){//answers end in the id of the submission they are for
+    std::string message = received;
+    std::string id;
+    size_t trailer = received.rfind("\nSUBMISSION ");
+    if(trailer != std::string::npos){
+        message = received.substr(0, trailer);
+        id = received.substr(trailer + 12);
+    }
+    auto submission = std::find_if(awaiting.begin(), awaiting.end(), [&](const Submission& s){ return id.empty() ? managers[s.manager] == from : s.id == id; });
+    if(submission == awaiting.end() && !id.empty())return;//answer to a resend that was already answered
+    if(submission == awaiting.end()){//a result without a tag, still acknowledged so the manager is not held up
+        boost::system::error_code error;
+        if(message.rfind("Client Initialized", 0) != 0)socket.send_to(boost::asio::buffer("NEXT RESULT"), boost::asio::ip::udp::endpoint(from.address(), from.port() + 1), 0, error);
+        return;
+    }
+    Submission answered = std::move(*submission);
+    awaiting.erase(submission);
+    if(message.rfind("Client Initialized", 0) == 0)return;
+    if(message.rfind("RETRY-AFTER ", 0) == 0){
+        long long wait = std::min(std::stoll(message.substr(12)) << std::min(answered.retries, 4), 60000LL);//backs off further if the manager keeps refusing
+        wait = wait * std::uniform_real_distribution<double>(0.5, 1.5)(jitter);//spreads out sessions that were refused together
+        answered.retries++;
+        answered.tries = 0;
+        answered.attempts = 0;
+        auto timer = std::make_shared<boost::asio::steady_timer>(strand, std::chrono::milliseconds(wait));
+        timer->async_wait([this, timer, answered = std::move(answered)](const boost::system::error_code& error) mutable {
+            if(!error)send(std::move(answered));
+        });
+        return;
+    }
+    for(std::string& tag : answered.tags){//ADMISSION REJECTED and the like, nothing in the submission was queued
+        complete(tag, JobResult::Rejected, message);
+    }
+}
+
+void Session::result(const std::string& message, const boost::asio::ip::udp::endpoint& from){//#<tag> <output>
+    boost::system::error_code error;
+    socket.send_to(boost::asio::buffer("NEXT RESULT"), boost::asio::ip::udp::endpoint(from.address(), from.port() + 1), 0, error);//the manager sends nothing else until this arrives
+    size_t space = message.find(' ');
+    std::string tag = message.substr(1, space - 1);
+    complete(tag, JobResult::Done, space == std::string::npos ? "" : message.substr(space + 1));
+}
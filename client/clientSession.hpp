@@ -0,0 +1,144 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <future>
+#include <optional>
+#include <random>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <boost/asio.hpp>
+
+// Client library for programs that submit jobs themselves instead of running ./client once per batch.
+// A Session keeps one socket open to the managers and can have thousands of jobs outstanding at once.
+// Every job carries a tag. The manager sends the tag back in front of the result, so results are delivered in the order they finish.
+// asyncSubmit takes any asio completion token: a callback, boost::asio::use_future, or boost::asio::use_awaitable to co_await it.
+// Jobs submitted close together travel in one submission datagram.
+// RETRY-AFTER from an overloaded manager is honoured with the same backoff as ./client.
+// An unanswered submission is resent to the same manager with a doubling timeout, and only then moves to the next manager on the ring.
+// Every submission carries an id the manager remembers, so a resend to a manager that was only slow is not queued twice.
+// Cancelling a job completes it straight away with Cancelled. This works through cancel(tag) or an asio cancellation slot, e.g. awaitable operators.
+// A job the manager already has is cancelled there too, so a queued job is dropped and a running one is killed.
+// A result already on its way when the cancel lands is dropped, so a tag should not be reused right after cancelling it.
+
+uint64_t hashKey(const std::string& key);
+
+class HashRing{//consistent hash ring of load managers, adding or removing one only moves the sessions next to it
+    private:
+        std::map<uint64_t, std::string> ring;
+        size_t managers = 0;
+    public:
+        static constexpr int virtualNodes = 64;
+
+        void add(std::string manager){
+            for(int i = 0; i < virtualNodes; i++){
+                ring[hashKey(manager + "#" + std::to_string(i))] = manager;
+            }
+            managers++;
+        }
+
+        std::vector<std::string> lookup(std::string key){//owner of key first, then the next managers on the ring to fail over to
+            std::vector<std::string> order;
+            auto it = ring.lower_bound(hashKey(key));
+            for(size_t i = 0; i < ring.size() && order.size() < managers; i++, it++){
+                if(it == ring.end())it = ring.begin();
+                if(std::find(order.begin(), order.end(), it->second) == order.end())order.push_back(it->second);
+            }
+            return order;
+        }
+};
+
+struct JobResult{
+    enum Status{Done, Cancelled, Rejected};
+    Status status = Done;
+    std::string tag;
+    std::string command;
+    std::string output;//what the process server sent back, or why the job was rejected
+};
+
+class Session{
+    public:
+        typedef boost::asio::any_completion_handler<void(JobResult)> Handler;
+
+        Session(boost::asio::io_context& io, const std::string& managers, std::string key = "");//managers is <ip>[:<base port>][,...] like ./client
+        ~Session();//only once the io_context has stopped or close has run
+
+        template <typename CompletionToken>
+        auto asyncSubmit(std::string tag, std::string command, CompletionToken&& token){//tag must be unique among this session's outstanding jobs and have no spaces
+            return boost::asio::async_initiate<CompletionToken, void(JobResult)>([this](auto handler, std::string tag, std::string command){
+                auto slot = boost::asio::get_associated_cancellation_slot(handler);
+                if(slot.is_connected())slot.assign([this, tag](boost::asio::cancellation_type){ cancel(tag); });
+                start(std::move(tag), std::move(command), Handler(std::move(handler)));
+            }, token, std::move(tag), std::move(command));
+        }
+
+        template <typename CompletionToken>
+        auto asyncSubmit(std::string command, CompletionToken&& token){
+            return asyncSubmit(newTag(), std::move(command), std::forward<CompletionToken>(token));
+        }
+
+        std::future<JobResult> submit(std::string command){
+            return asyncSubmit(std::move(command), boost::asio::use_future);
+        }
+
+        std::string newTag(){ return "j" + std::to_string(tagCounter++); }
+        void cancel(const std::string& tag);//safe from any thread, the job completes with Cancelled unless it already finished
+        void close();//cancels everything outstanding and stops receiving
+        size_t outstanding() const{ return jobCount.load(); }
+
+    private:
+        struct Job{
+            std::string command;
+            Handler handler;
+            std::optional<size_t> manager;//where it was submitted, set once it has been sent
+        };
+        struct Submission{
+            std::string id;//SUBMISSION <id> heads the text and stays the same across resends
+            std::string text;
+            std::vector<std::string> tags;
+            size_t manager = 0;//index into managers, the same submission moves on when one does not answer
+            size_t tries = 0;//managers given up on so far
+            int attempts = 0;//sends to the current manager
+            int retries = 0;//RETRY-AFTER answers so far
+            std::chrono::steady_clock::time_point sentAt;
+        };
+
+        static constexpr size_t maxSubmission = 1000;//the manager reads submissions into 1024 byte buffers
+        static constexpr size_t maxHeader = 64;//room for the SUBMISSION line
+        static constexpr auto replyTimeout = std::chrono::milliseconds(1000);//doubles with every resend to the same manager
+        static constexpr int managerAttempts = 3;//sends to one manager before failing over, a slow manager gets 7 s
+
+        boost::asio::strand<boost::asio::io_context::executor_type> strand;//every member below is only touched here
+        boost::asio::ip::udp::socket socket;
+        boost::asio::steady_timer replyTimer;
+        std::vector<boost::asio::ip::udp::endpoint> managers;//in ring order for this session's key
+        std::unordered_map<std::string, Job> jobs;
+        std::vector<std::string> unsent;
+        std::deque<Submission> awaiting;//sent without an answer yet
+        std::map<size_t, std::string> cancels;//manager to the tags of a CANCEL not sent yet
+        std::vector<char> buf;
+        std::string sessionID;//random, so ids from two sessions on one host never collide at a manager
+        size_t submissionCounter = 0;
+        boost::asio::ip::udp::endpoint sender;
+        bool flushing = false;
+        bool cancelling = false;
+        bool timing = false;
+        bool closed = false;
+        std::mt19937 jitter{std::random_device{}()};
+        std::atomic<size_t> tagCounter = 0;
+        std::atomic<size_t> jobCount = 0;
+
+        void start(std::string tag, std::string command, Handler handler);
+        void complete(const std::string& tag, JobResult::Status status, std::string output);
+        Submission newSubmission();
+        void flush();
+        void flushCancels();
+        void send(Submission submission);
+        void receive();
+        void reply(const std::string& message, const boost::asio::ip::udp::endpoint& from);
+        void result(const std::string& message, const boost::asio::ip::udp::endpoint& from);
+        void checkReplies();
+};
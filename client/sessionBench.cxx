@@ -0,0 +1,73 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <optional>
+#include <boost/asio.hpp>
+#include "clientSession.hpp"
+
+//by Robert Britton
+
+// g++ -std=c++20 -O2 -I. -pthread sessionBench.cxx clientSession.cxx -o sessionBench
+// ./sessionBench <manager ip>[:<base port>][,...] [<jobs>] [<command>] [<cancel every nth job>]
+// keeps every job outstanding at once from one session, each awaited by its own coroutine,
+// and prints jobs/sec with the first results in the order they finished
+
+struct Tally{
+    size_t done = 0;
+    size_t cancelled = 0;
+    size_t rejected = 0;
+    size_t shown = 0;
+    size_t total = 0;
+    std::optional<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work;//results arrive from the session's thread, not from work of this context
+};
+
+boost::asio::awaitable<void> awaitJob(Session& session, std::string tag, std::string command, Tally& tally){
+    JobResult result = co_await session.asyncSubmit(tag, command, boost::asio::use_awaitable);
+    if(result.status == JobResult::Done)tally.done++;
+    else if(result.status == JobResult::Cancelled)tally.cancelled++;
+    else{
+        if(tally.rejected++ == 0)std::cerr << "rejected: " << result.output << std::endl;
+    }
+    if(result.status == JobResult::Done && tally.shown++ < 3)std::cout << "finished " << result.tag << ": " << result.output << std::endl;
+    if(tally.done + tally.cancelled + tally.rejected == tally.total)tally.work.reset();
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 2){ std::cerr << "usage: sessionBench <manager ip>[:<base port>][,...] [<jobs>] [<command>] [<cancel every nth job>]\n"; return 1; }
+    size_t jobs = argc > 2 ? std::stoull(argv[2]) : 1000;
+    std::string command = argc > 3 ? argv[3] : "true";
+    size_t cancelEvery = argc > 4 ? std::stoull(argv[4]) : 0;
+
+    boost::asio::io_context io;
+    auto work = boost::asio::make_work_guard(io);
+    std::thread ioThread([&io]{ io.run(); });
+    Session session(io, argv[1]);
+
+    JobResult first = session.submit("echo session up").get();//plain futures work from any thread
+    if(first.status != JobResult::Done){
+        std::cerr << "first job failed: " << first.output << std::endl;
+        return 1;
+    }
+
+    Tally tally;
+    boost::asio::io_context coroutines;//one thread, so the tally needs no lock
+    tally.total = jobs;
+    tally.work.emplace(coroutines.get_executor());
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < jobs; i++){
+        std::string tag = "b" + std::to_string(i);
+        boost::asio::co_spawn(coroutines, awaitJob(session, tag, command, tally), boost::asio::detached);
+    }
+    boost::asio::post(coroutines, [&]{//runs once every coroutine has submitted
+        for(size_t i = 0; cancelEvery > 0 && i < jobs; i += cancelEvery)session.cancel("b" + std::to_string(i));
+    });
+    coroutines.run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << jobs << " jobs: " << tally.done << " done, " << tally.cancelled << " cancelled, " << tally.rejected << " rejected in "
+              << seconds << "s, " << (size_t)(tally.done / seconds) << " jobs/sec" << std::endl;
+
+    session.close();
+    work.reset();
+    ioThread.join();
+    return 0;
+}
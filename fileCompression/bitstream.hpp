@@ -0,0 +1,140 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+// Bit level writer and reader used by the Huffman coder.
+// Bits go out most significant first, the same order the original string packing used, so files stay readable by either version.
+// Codes collect in a 64 bit accumulator that is stored 8 bytes at a time straight into the output vector.
+// The vector is grown ahead of the writer and only has its real size again after flush.
+// The reader keeps the next bits left aligned in a 64 bit buffer so a decoder can peek at several codes at once.
+
+// stores a word big endian, compilers turn this into a single byteswapped store
+inline void storeBigEndian(uint8_t* out, uint64_t word){
+    for(int i = 0; i < 8; i++){
+        out[i] = (uint8_t)(word >> (56 - 8 * i));
+    }
+}
+
+// loads a word big endian, the counterpart of storeBigEndian
+inline uint64_t loadBigEndian(const uint8_t* in){
+    uint64_t word = 0;
+    for(int i = 0; i < 8; i++){
+        word = (word << 8) | in[i];
+    }
+    return word;
+}
+
+class BitWriter{
+    public:
+        explicit BitWriter(std::vector<uint8_t>& output): output(output), start(output.size()), position(output.size()) {}
+
+        // appends the low length bits of bits, length can be 0 to 64
+        void write(uint64_t bits, uint32_t length){
+            if(length == 0){
+                return;
+            }
+            if(length < 64){
+                bits &= (1ULL << length) - 1;
+            }
+            if(count + length < 64){
+                buffer |= bits << (64 - count - length);
+                count += length;
+                return;
+            }
+            // the accumulator fills up, the bits that do not fit start the next word
+            uint32_t spill = count + length - 64;
+            buffer |= bits >> spill;
+            put(buffer);
+            buffer = spill == 0 ? 0 : bits << (64 - spill);
+            count = spill;
+        }
+
+        // writes out the last partial word, the final byte is padded with zeros
+        void flush(){
+            put(buffer);
+            position -= 8 - (count + 7) / 8;
+            output.resize(position);
+            buffer = 0;
+            count = 0;
+        }
+
+        // bits written so far, including the ones still in the accumulator
+        size_t bitCount() const{
+            return (position - start) * 8 + count;
+        }
+
+        // bytes stored in the output so far, they are final and are not touched again
+        size_t bytesWritten() const{
+            return position - start;
+        }
+
+    private:
+        std::vector<uint8_t>& output;
+        size_t start;
+        size_t position;// the vector is grown ahead of this and cut back by flush
+        uint64_t buffer = 0;
+        uint32_t count = 0;
+
+        void put(uint64_t word){
+            if(position + 8 > output.size()){
+                output.resize(std::max(output.size() * 2, position + 4096));
+            }
+            storeBigEndian(output.data() + position, word);
+            position += 8;
+        }
+};
+
+class BitReader{
+    public:
+        BitReader(const uint8_t* data, size_t size): current(data), end(data + size) {}
+
+        // tops the buffer up to at least 56 bits, fewer only once the input runs out
+        void refill(){
+            if(end - current >= 8){
+                // whole bytes that fit are taken from one load, the rest of the load is read again next time
+                buffer |= loadBigEndian(current) >> count;
+                current += (63 - count) >> 3;
+                count |= 56;
+            }
+            else{
+                while(count <= 56 && current < end){
+                    buffer |= (uint64_t)*current++ << (56 - count);
+                    count += 8;
+                }
+            }
+        }
+
+        // the next length bits without consuming them, length can be 1 to 56, bits past the end read as zeros
+        uint64_t peek(uint32_t length) const{
+            return buffer >> (64 - length);
+        }
+
+        // drops length bits, at most what was refilled
+        void consume(uint32_t length){
+            buffer <<= length;
+            count -= length;
+        }
+
+        // bits in the buffer, peeks up to this many are real input
+        uint32_t bufferedBits() const{
+            return count;
+        }
+
+        // the next byte a refill loads, nothing past it plus 8 bytes has been read yet
+        const uint8_t* position() const{
+            return current;
+        }
+
+        // bits not consumed yet, buffered or not
+        size_t bitsLeft() const{
+            return count + (size_t)(end - current) * 8;
+        }
+
+    private:
+        const uint8_t* current;
+        const uint8_t* end;
+        uint64_t buffer = 0;
+        uint32_t count = 0;
+};
@@ -1,40 +1,30 @@
 // importing necessary things
 #include "compression.hpp"
 #include "encryption.hpp"
+#include "huffman.hpp"
+#include "histogram.hpp"
+#include "threadPool.hpp"
+#include "lz77.hpp"
+#include <array>
+#include <deque>
+#include <thread>
+#include <future>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <vector>
 #include <cstdint>
 #include <fstream>
 #include <iterator>
 #include <iostream>
-#include <unordered_map>
-#include <queue>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 
-// tree node used for compression
-struct TreeNode{
-    uint8_t val;
-    uint64_t freq;
-    TreeNode* right;
-    TreeNode* left;
-
-    // leaf nodes have the bytes
-    TreeNode(uint8_t value, uint64_t frequency): val(value), freq(frequency), right(nullptr), left(nullptr) {}
-    // internal nodes only carry frequency
-    TreeNode(TreeNode* leftNode, TreeNode* rightNode): val(0), freq(rightNode->freq + leftNode->freq), right(rightNode), left(leftNode) {}
-
-    bool isLeaf(){
-        return (left == nullptr && right == nullptr);
-    }
-};
-
-// comparator between tree nodes
-struct Comparator{
-    bool operator()(const TreeNode* l, const TreeNode* r){
-        return l->freq > r->freq;
-    }
-};
-
 // function to read from a binary file
 std::vector<uint8_t> readBinaryFile(const std::string& fileName){
     // opening file
@@ -52,339 +42,775 @@ std::vector<uint8_t> readBinaryFile(const std::string& fileName){
 }
 
 
-// function that goes through data and maps frequency of each byte
-std::unordered_map<uint8_t, uint64_t> findFrequency(std::vector<uint8_t>& binaryFile){
-    std::unordered_map<uint8_t, uint64_t> frequencyMap = {};
-    for(uint8_t byte: binaryFile){
-        if(frequencyMap.find(byte) == frequencyMap.end()){
-            frequencyMap[byte] = 1;
+// read only view of a whole file, the kernel pages it in as it is read instead of it all being copied up front
+class MappedFile{
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile(){
+            if(size > 0){
+                munmap((void*)data, size);
+            }
         }
-        else{
-            frequencyMap[byte] += 1;
+
+        // false if the file cannot be opened or mapped, an empty file opens with nothing mapped
+        bool open(const std::string& fileName){
+            int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0){
+                return false;
+            }
+            struct stat info;
+            if(fstat(fd, &info) != 0){
+                close(fd);
+                return false;
+            }
+            if(info.st_size > 0){
+                void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(mapped == MAP_FAILED){
+                    close(fd);
+                    return false;
+                }
+                // read front to back once, so pages can be read ahead and dropped behind
+                madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+                data = (const uint8_t*)mapped;
+                size = info.st_size;
+            }
+            close(fd);
+            return true;
         }
-    }
-    return frequencyMap;
-}
 
-// function that builds the tree given a frequency map
-TreeNode* buildTreeFromMap(std::unordered_map<uint8_t, uint64_t> map){
-    // creating a min heap
-    std::priority_queue<TreeNode*, std::vector<TreeNode*>, Comparator> minHeap;
+        // done with everything before offset, its pages are let go so only the part being worked on stays resident
+        // they are still in the page cache, nothing is read twice if they are looked at again
+        void release(size_t offset){
+            size_t page = sysconf(_SC_PAGESIZE);
+            size_t end = std::min(offset, size) / page * page;
+            if(end > released){
+                madvise((void*)(data + released), end - released, MADV_DONTNEED);
+                released = end;
+            }
+        }
 
-    // populating it
-    for(const auto& pair: map){
-        minHeap.push(new TreeNode(pair.first, pair.second));
-    }
+        const uint8_t* data = nullptr;
+        size_t size = 0;
 
-    // building the tree
-    while(minHeap.size() > 1){
-        TreeNode* left = minHeap.top();
-        minHeap.pop();
-        TreeNode* right = minHeap.top();
-        minHeap.pop();
+    private:
+        size_t released = 0;
+};
 
-        TreeNode* newNode = new TreeNode(left, right);
-        minHeap.push(newNode);
+// function that reads a little endian integer of size bytes
+uint64_t loadLittleEndian(const uint8_t* data, int size){
+    uint64_t value = 0;
+    for(int i = 0; i < size; i++){
+        value |= (uint64_t)data[i] << (8 * i);
     }
-
-    return minHeap.top();
+    return value;
 }
 
-// recursive algorithm
-void dfs(TreeNode* node, std::string currPath, std::unordered_map<uint8_t, std::string>& map){
-    if(node == nullptr){
-        return;
-    }
-
-    if(node->isLeaf()){
-        map[node->val] = currPath;
-    }
-    else{
-        dfs(node->left, currPath + "0", map);
-        dfs(node->right, currPath + "1", map);
+// function that appends a little endian integer of size bytes
+void storeLittleEndian(std::vector<uint8_t>& output, uint64_t value, int size){
+    for(int i = 0; i < size; i++){
+        output.push_back((uint8_t)(value >> (8 * i)));
     }
 }
 
-// function that returns a map of encodings given a tree
-std::unordered_map<uint8_t, std::string> getEncodings(TreeNode* root){
-    std::unordered_map<uint8_t, std::string> encodings = {};
-
-    // calling recursive function to populate map
-    dfs(root, "", encodings);
+// encryption key shared by the compressor and decompressor
+const u_int8_t global_key[32] = {
+    0x50, 0x61, 0x62, 0x6C, 0x6F, 0x20, 0x66, 0x6F,
+    0x72, 0x20, 0x50, 0x72, 0x65, 0x73, 0x69, 0x64,
+    0x65, 0x6E, 0x74, 0x20, 0x6F, 0x66, 0x20, 0x43,
+    0x6F, 0x6C, 0x6F, 0x6D, 0x62, 0x69, 0x61, 0x21
+};
 
-    return encodings;
-}
 
-// function to serialize the tree
-void serializeTree(TreeNode* node, std::string& output){
-    if(node == nullptr){
-        return;
-    }
 
-    if(node->isLeaf()){
-        output += "1";
-        for(int i = 7; i >= 0; i--){
-            output += ((node->val >> i) & 1) ? '1' : '0';
-        }
-    }
-    else{
-        output += "0";
-        serializeTree(node->left, output);
-        serializeTree(node->right, output);
-    }
+// file layout, versions 3 and 4:
+//   4 bytes    "CMP" and the version
+//   12 bytes   nonce
+//   4 bytes    block size, no block holds more original bytes than this
+//   blocks     each one on its own, and an empty block to end them:
+//     4 bytes    original size of the block
+//     4 bytes    size of its codes
+//     1 byte     version 4 only, how the block is coded, huffmanBlock or lz77Block, left out of the empty block
+//     then for huffmanBlock, the only kind version 3 has:
+//       lengths    code lengths as writeCodeLengths lays them out
+//       codes      the encrypted codes of the bytes
+//     or for lz77Block, the block parsed into literals and sequences (see lz77.hpp):
+//       4 bytes    number of literals
+//       4 bytes    number of sequences
+//       lengths    code lengths of the literals, then of the symbols of the literal runs, match lengths and distances
+//       codes      the encrypted codes: every literal, every run symbol, every length symbol, every distance symbol,
+//                  then the extra bits of each sequence's run, length and distance in turn
+//   index      8 bytes for each block, where it starts in the file
+//   8 bytes    number of blocks
+// block n is encrypted with the keystream from n * 2 * block size on, so every block can be decrypted on its own
+// level 0 writes version 3, higher levels version 4
+// all sizes are little endian
+
+const uint8_t formatMagic[3] = {'C', 'M', 'P'};
+constexpr uint8_t huffmanVersion = 3;
+constexpr uint8_t lz77Version = 4;
+
+constexpr uint8_t huffmanBlock = 0;
+constexpr uint8_t lz77Block = 1;
+
+// blocks are big enough that their code lengths cost next to nothing and small enough that a block read for its histogram
+// is still in the L2 cache when it is coded, codes also fit the bytes of a shorter stretch of the file better
+constexpr uint32_t blockSize = 1 << 18;
+
+// codes of a block never take more than 15 bits a byte, so each block's keystream ends before the next one's starts
+// it follows the block size in the file, files written with other block sizes still decrypt
+uint64_t keystreamStride(uint64_t largestBlock){
+    return 2 * largestBlock;
 }
 
+// codes are encrypted and decrypted this many original bytes at a time, right next to the coding, while they are still in the L1 cache
+constexpr size_t pieceSize = 16 << 10;
 
-// function that takes in the binary file, compresses it, and returns a compressed version
-std::string compressFile(const std::string& inputExe){
-    // first getting the bytes in a vector representation
-    std::vector<uint8_t> binary = readBinaryFile(inputExe);
+// one block's worth of work, kept from block to block so the buffers are only allocated once
+struct BlockBuffers{
+    std::vector<uint8_t> header;
+    std::vector<uint8_t> codes;
+    std::vector<uint8_t> output;
+    // LZ77 blocks only: the literals, the symbols of every sequence, runs then lengths then distances, and the parse
+    std::vector<uint8_t> literals;
+    std::vector<uint8_t> symbols;
+    std::vector<Sequence> sequences;
+    MatchFinder matches;
+    bool decoded = false;
+};
 
-    // getting a frequency map of each pattern
-    std::unordered_map<uint8_t, uint64_t> frequencyMap = findFrequency(binary);
+// function that picks how many threads to use, 0 means every core
+unsigned threadCount(unsigned threads){
+    return threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
 
-    // building a tree with the most frequent bytes near the root
-    TreeNode* root = buildTreeFromMap(frequencyMap);
+// keeps the codes encrypted in place up to the last whole 64 byte keystream block the writer has stored, so every piece is
+// encrypted while it is still in the L1 cache and the wide ChaCha paths get full groups
+class CodeEncryptor{
+    public:
+        CodeEncryptor(std::vector<uint8_t>& codes, const uint8_t nonce[12], uint64_t keystreamOffset): codes(codes), nonce(nonce), keystreamOffset(keystreamOffset) {}
 
-    // once we have the tree, need to traverse it and get a map of each byte to its encoding
-    std::unordered_map<uint8_t, std::string> encodings = getEncodings(root);
+        void catchUp(const BitWriter& writer){
+            encryptTo(writer.bytesWritten() / 64 * 64);
+        }
 
-    // now that we have encodings, we can finally compress the data
-    std::string compressedData = "";
-    for(uint8_t byte: binary){
-        compressedData += encodings[byte];
-    }
+        // the rest, once the writer is flushed
+        void finish(){
+            encryptTo(codes.size());
+        }
 
-    // now packing our string into bytes 
-    std::vector<uint8_t> finalBytes;
-    int bits = 0;
-    uint8_t currByte = 0;
+    private:
+        std::vector<uint8_t>& codes;
+        const uint8_t* nonce;
+        uint64_t keystreamOffset;
+        size_t encrypted = 0;
 
-    for(char bit: compressedData){
-        currByte <<= 1;
-        if(bit == '1'){
-            currByte |= 1;
+        void encryptTo(size_t end){
+            static const chacha_path path = chacha_best_path();
+            chacha_xor(codes.data() + encrypted, codes.data() + encrypted, end - encrypted, global_key, nonce, keystreamOffset + encrypted, path);
+            encrypted = end;
         }
-        bits += 1;
+};
 
-        if(bits == 8){
-            finalBytes.push_back(currByte);
-            currByte = 0;
-            bits = 0;
+// function that writes the codes of count symbols, encrypting behind the writer a piece at a time
+void writeSymbols(const uint8_t* symbols, size_t count, const std::array<Code, 256>& encodings, BitWriter& writer, CodeEncryptor& encryptor){
+    for(size_t start = 0; start < count; start += pieceSize){
+        size_t end = std::min(count, start + pieceSize);
+        for(size_t i = start; i < end; i++){
+            writer.write(encodings[symbols[i]].bits, encodings[symbols[i]].length);
         }
+        encryptor.catchUp(writer);
     }
+}
 
-    if(bits > 0){
-        currByte <<= (8-bits);
-        finalBytes.push_back(currByte);
+// function that adds up how many bits the codes of every symbol take
+uint64_t codedBits(const std::array<uint64_t, 256>& frequencies, const CodeLengths& lengths){
+    uint64_t bits = 0;
+    for(int symbol = 0; symbol < 256; symbol++){
+        bits += frequencies[symbol] * lengths[symbol];
     }
+    return bits;
+}
 
-    // need to serialize the tree so decoder can decode
-    std::string serializedTree = "";
-    serializeTree(root, serializedTree);
-
-    // packing those bits into a vector
-    std::vector<uint8_t> finalBytesTree;
+// the values a sequence is sent as: its run, its length past minMatch, and its distance, or 0 for the same distance as
+// the match before it, which machine code has a lot of from tables and repeated instruction patterns
+struct SequenceCodes{
+    ValueCode run;
+    ValueCode length;
+    ValueCode distance;
+};
 
-    bits = 0;
-    currByte = 0;
+inline SequenceCodes sequenceCodes(const Sequence& sequence, uint32_t& lastDistance){
+    SequenceCodes codes = {valueCode(sequence.literals), valueCode(sequence.length - minMatch),
+                           valueCode(sequence.distance == lastDistance ? 0 : sequence.distance)};
+    lastDistance = sequence.distance;
+    return codes;
+}
 
-    for(char bit: serializedTree){
-        currByte <<= 1;
-        if(bit == '1'){
-            currByte |= 1;
-        }
-        bits += 1;
+// function that parses a block with LZ77 and codes it, false without writing anything if that would not beat plainBytes,
+// what Huffman codes of the bytes take
+bool compressLZ77Block(const uint8_t* data, size_t size, int level, uint64_t plainBytes, const uint8_t nonce[12], uint64_t keystreamOffset, BlockBuffers& buffers){
+    buffers.matches.parse(data, size, level, buffers.literals, buffers.sequences);
+    const std::vector<uint8_t>& literals = buffers.literals;
+    const std::vector<Sequence>& sequences = buffers.sequences;
+    size_t count = sequences.size();
+
+    // the literals are one stream and the run, length and distance symbols three more, each with its own codes
+    std::array<std::array<uint64_t, 256>, 4> frequencies = {};
+    frequencies[0] = byteHistogram(literals.data(), literals.size());
+    std::vector<uint8_t>& symbols = buffers.symbols;
+    symbols.resize(3 * count);
+    uint64_t bits = 0;
+    uint32_t lastDistance = 0;
+    for(size_t i = 0; i < count; i++){
+        SequenceCodes values = sequenceCodes(sequences[i], lastDistance);
+        symbols[i] = values.run.symbol;
+        symbols[count + i] = values.length.symbol;
+        symbols[2 * count + i] = values.distance.symbol;
+        frequencies[1][values.run.symbol]++;
+        frequencies[2][values.length.symbol]++;
+        frequencies[3][values.distance.symbol]++;
+        bits += values.run.extraBits + values.length.extraBits + values.distance.extraBits;
+    }
+    std::array<CodeLengths, 4> lengths;
+    std::array<std::array<Code, 256>, 4> encodings;
+    size_t headerBytes = 17;
+    for(int stream = 0; stream < 4; stream++){
+        lengths[stream] = buildCodeLengths(frequencies[stream]);
+        encodings[stream] = canonicalCodes(lengths[stream]);
+        bits += codedBits(frequencies[stream], lengths[stream]);
+        headerBytes += codeLengthsSize(lengths[stream]);
+    }
+    if(headerBytes + (bits + 7) / 8 >= plainBytes){
+        return false;
+    }
 
-        if(bits == 8){
-            finalBytesTree.push_back(currByte);
-            currByte = 0;
-            bits = 0;
+    std::vector<uint8_t>& codes = buffers.codes;
+    codes.clear();
+    codes.reserve(bits / 8 + 8);
+    BitWriter writer(codes);
+    CodeEncryptor encryptor(codes, nonce, keystreamOffset);
+    writeSymbols(literals.data(), literals.size(), encodings[0], writer, encryptor);
+    for(int stream = 1; stream < 4; stream++){
+        writeSymbols(symbols.data() + (stream - 1) * count, count, encodings[stream], writer, encryptor);
+    }
+    lastDistance = 0;
+    for(size_t start = 0; start < count; start += pieceSize){
+        size_t end = std::min(count, start + pieceSize);
+        for(size_t i = start; i < end; i++){
+            SequenceCodes values = sequenceCodes(sequences[i], lastDistance);
+            writer.write(values.run.extra, values.run.extraBits);
+            writer.write(values.length.extra, values.length.extraBits);
+            writer.write(values.distance.extra, values.distance.extraBits);
         }
+        encryptor.catchUp(writer);
     }
-
-    if(bits > 0){
-        currByte <<= (8-bits);
-        finalBytesTree.push_back(currByte);
+    writer.flush();
+    encryptor.finish();
+
+    buffers.header.clear();
+    storeLittleEndian(buffers.header, size, 4);
+    storeLittleEndian(buffers.header, codes.size(), 4);
+    buffers.header.push_back(lz77Block);
+    storeLittleEndian(buffers.header, literals.size(), 4);
+    storeLittleEndian(buffers.header, count, 4);
+    for(const CodeLengths& streamLengths: lengths){
+        writeCodeLengths(streamLengths, buffers.header);
     }
+    return true;
+}
 
-    // encrpyting the data being sent
-    const u_int8_t global_key[32] = {
-        0x50, 0x61, 0x62, 0x6C, 0x6F, 0x20, 0x66, 0x6F,
-        0x72, 0x20, 0x50, 0x72, 0x65, 0x73, 0x69, 0x64,
-        0x65, 0x6E, 0x74, 0x20, 0x6F, 0x66, 0x20, 0x43,
-        0x6F, 0x6C, 0x6F, 0x6D, 0x62, 0x69, 0x61, 0x21
-    };
+// function that codes one block and encrypts it, header and encrypted codes go in buffers
+// level 0 Huffman codes the bytes, higher levels try LZ77 first and keep it when it comes out smaller
+// methods is whether the header has the byte saying which one it is, version 3 files do not
+void compressBlock(const uint8_t* data, size_t size, int level, bool methods, const uint8_t nonce[12], uint64_t keystreamOffset, BlockBuffers& buffers){
+    // getting the frequency of each byte
+    std::array<uint64_t, 256> frequencies = byteHistogram(data, size);
+
+    // code lengths from a Huffman tree, no longer than 15 bits, and the canonical codes they give
+    CodeLengths lengths = buildCodeLengths(frequencies);
+    std::array<Code, 256> encodings = canonicalCodes(lengths);
 
+    // the exact output size is known from the frequencies
+    uint64_t totalBits = codedBits(frequencies, lengths);
+    if(level > 0 && compressLZ77Block(data, size, level, 9 + codeLengthsSize(lengths) + (totalBits + 7) / 8, nonce, keystreamOffset, buffers)){
+        return;
+    }
+    std::vector<uint8_t>& codes = buffers.codes;
+    codes.clear();
+    codes.reserve(totalBits / 8 + 8);
+
+    // now that we have encodings, we can finally compress the data straight into bytes, encrypted behind the writer
+    BitWriter writer(codes);
+    CodeEncryptor encryptor(codes, nonce, keystreamOffset);
+    writeSymbols(data, size, encodings, writer, encryptor);
+    writer.flush();
+    encryptor.finish();
+
+    buffers.header.clear();
+    storeLittleEndian(buffers.header, size, 4);
+    storeLittleEndian(buffers.header, codes.size(), 4);
+    if(methods){
+        buffers.header.push_back(huffmanBlock);
+    }
+    writeCodeLengths(lengths, buffers.header);
+}
+
+// function that compresses size bytes from data into sink, pages of mapping before the blocks done are let go if there is one
+bool compressBlocks(const uint8_t* data, size_t size, const ByteSink& sink, unsigned threads, int level, MappedFile* mapping){
+    level = std::clamp(level, 0, maxLevel);
     uint8_t nonce[12] = {0};
     for(int i = 0; i < 12; i++){
         nonce[i] = (uint8_t)rand();
     }
-    std::vector<uint8_t> encryptedData = encrypt_data(finalBytes, global_key, nonce);
+    std::vector<uint8_t> fileHeader(formatMagic, formatMagic + 3);
+    fileHeader.push_back(level > 0 ? lz77Version : huffmanVersion);
+    fileHeader.insert(fileHeader.end(), nonce, nonce + 12);
+    storeLittleEndian(fileHeader, blockSize, 4);
+    if(!sink(fileHeader.data(), fileHeader.size())){
+        return false;
+    }
+    uint64_t written = fileHeader.size();
+
+    // blocks are coded on the pool and written here in order, with a couple per thread in flight so none wait on the writer
+    size_t blocks = (size + blockSize - 1) / blockSize;
+    unsigned workers = threadCount(threads);
+    size_t window = 2 * (size_t)workers;
+    std::vector<BlockBuffers> slots(window);
+    std::deque<std::future<void>> pending;
+    std::vector<uint8_t> index;
+    ThreadPool pool(workers);
+    bool stopped = false;
+    for(size_t block = 0, submitted = 0; block < blocks && !stopped; block++){
+        for(; submitted < blocks && submitted < block + window; submitted++){
+            pending.push_back(pool.submit([&, submitted]{
+                size_t start = submitted * blockSize;
+                compressBlock(data + start, std::min<size_t>(blockSize, size - start), level, level > 0, nonce, submitted * keystreamStride(blockSize),
+                              slots[submitted % window]);
+            }));
+        }
+        pending.front().get();
+        pending.pop_front();
+
+        BlockBuffers& done = slots[block % window];
+        storeLittleEndian(index, written, 8);
+        stopped = !sink(done.header.data(), done.header.size()) || !sink(done.codes.data(), done.codes.size());
+        written += done.header.size() + done.codes.size();
+        if(mapping != nullptr){
+            mapping->release((block + 1) * blockSize);
+        }
+    }
 
+    // blocks still in flight use the slots, so they finish before those go away
+    for(std::future<void>& task: pending){
+        task.get();
+    }
+    if(stopped){
+        return false;
+    }
 
-    // writing to the file
-    std::ofstream outputFile(inputExe + ".cmp", std::ios::binary);
+    // the empty block marks the end of the blocks, then the index and how many blocks it has
+    std::vector<uint8_t> end(8, 0);
+    storeLittleEndian(index, blocks, 8);
+    return sink(end.data(), end.size()) && sink(index.data(), index.size());
+}
 
-    uint32_t treeSize = static_cast<uint32_t>(finalBytesTree.size());
+ByteSink descriptorSink(int fd){
+    return [fd](const uint8_t* data, size_t size){
+        while(size > 0){
+            ssize_t n = write(fd, data, size);
+            if(n < 0 && errno == EINTR){
+                continue;
+            }
+            if(n <= 0){
+                return false;
+            }
+            data += n;
+            size -= n;
+        }
+        return true;
+    };
+}
 
-    // std::cout << "tree size is " << treeSize << std::endl;
+bool compressBuffer(std::span<const uint8_t> input, const ByteSink& sink, unsigned threads, int level){
+    return compressBlocks(input.data(), input.size(), sink, threads, level, nullptr);
+}
 
-    for(int i = 0; i < 12; i++){
-        outputFile.write(reinterpret_cast<const char*>(&nonce[i]), sizeof(nonce[i]));
+std::vector<uint8_t> compressBuffer(std::span<const uint8_t> input, unsigned threads, int level){
+    std::vector<uint8_t> output;
+    compressBuffer(input, [&](const uint8_t* data, size_t size){
+        output.insert(output.end(), data, data + size);
+        return true;
+    }, threads, level);
+    return output;
+}
+
+// function that takes in the binary file, compresses it, and returns the name of the compressed version
+std::string compressFile(const std::string& inputExe, unsigned threads, int level){
+    // the input is mapped, so only the blocks being worked on have to be in memory
+    MappedFile input;
+    if(!input.open(inputExe)){
+        std::cout << "File " << inputExe << " could not be opened" << std::endl;
+        return "";
     }
-    outputFile.write(reinterpret_cast<const char*>(&treeSize), sizeof(treeSize));
-    outputFile.write(reinterpret_cast<const char*>(finalBytesTree.data()), finalBytesTree.size());
-    outputFile.write(reinterpret_cast<const char*>(encryptedData.data()), encryptedData.size());
 
+    // writing to the file
+    std::string fileName = inputExe + ".cmp";
+    std::ofstream outputFile(fileName, std::ios::binary);
+    bool written = compressBlocks(input.data, input.size, [&](const uint8_t* data, size_t size){
+        outputFile.write(reinterpret_cast<const char*>(data), size);
+        return outputFile.good();
+    }, threads, level, &input);
     outputFile.close();
-
-    // std::cout << "old had a size of " << binary.size() << " bytes"<< std::endl;
-    // std::cout << "compressed has a size of " << finalBytes.size() << " bytes" << std::endl;
-    // std::cout << "compressed file is " << (int)((static_cast<float>(finalBytes.size()) / binary.size()) * 100) << "% of original file" << std::endl;
-
+    if(!written || outputFile.fail()){
+        std::cout << "File " << fileName << " could not be written" << std::endl;
+        std::remove(fileName.c_str());
+        return "";
+    }
 
     // returning name of output
-    return inputExe + ".cmp";
+    return fileName;
 }
 
 
 //--------------------CODE TO DECOMPRESS FILE------------------------------
 
-// recursively called function to build the tree
-TreeNode* recursiveBuildTree(const std::string& bits, int& index){
-    if(index >= bits.size()){
-        return nullptr;
-    }
+// decrypts the codes out of the mapping into the block's buffer just ahead of the reader, a piece at a time, so each byte is
+// decrypted and decoded while it is in the L1 cache
+class CodeDecryptor{
+    public:
+        CodeDecryptor(const uint8_t* encrypted, std::vector<uint8_t>& codes, const uint8_t nonce[12], uint64_t keystreamOffset):
+            encrypted(encrypted), codes(codes), nonce(nonce), keystreamOffset(keystreamOffset) {}
+
+        // makes sure the next bytes past where the reader is are decrypted, the reader also loads up to 8 bytes past that
+        void ahead(const BitReader& reader, size_t bytes){
+            static const chacha_path path = chacha_best_path();
+            size_t needed = std::min(codes.size(), (size_t)(reader.position() - codes.data()) + bytes + 16);
+            if(needed > decrypted){
+                chacha_xor(encrypted + decrypted, codes.data() + decrypted, needed - decrypted, global_key, nonce, keystreamOffset + decrypted, path);
+                decrypted = needed;
+            }
+        }
 
-    if(bits[index] == '1'){
-        index++;
+    private:
+        const uint8_t* encrypted;
+        std::vector<uint8_t>& codes;
+        const uint8_t* nonce;
+        uint64_t keystreamOffset;
+        size_t decrypted = 0;
+};
 
-        uint8_t val = 0;
-        for(int i = 0; i < 8; i++){
-            val <<= 1;
-            if(bits[index] == '1'){
-                val |= 1;
-            }
-            index++;
+// function that decodes count symbols into output, decrypting ahead a piece at a time, a symbol never takes more than 15 bits
+bool readSymbols(const HuffmanDecoder& decoder, BitReader& reader, CodeDecryptor& decryptor, uint8_t* output, size_t count){
+    for(size_t start = 0; start < count; start += 4 * pieceSize){
+        size_t piece = std::min(4 * pieceSize, count - start);
+        decryptor.ahead(reader, piece * maxCodeLength / 8);
+        if(!decoder.decode(reader, output + start, piece)){
+            return false;
         }
-        return new TreeNode(val, 0);
-    }
-    else{
-        index++;
-        TreeNode* left = recursiveBuildTree(bits, index);
-        TreeNode* right = recursiveBuildTree(bits, index);
-        return new TreeNode(left, right);
     }
+    return true;
 }
 
-
-// function to help rebuild the tree
-TreeNode* buildTreeFromVector(std::vector<uint8_t> compressedTree){
-    std::string bits = "";
-
-    for(uint8_t byte: compressedTree){
-        for(int i = 7; i >= 0; i--){
-            bits += ((byte >> i) & 1) ? '1' : '0';
+// function that reads a value's extra bits and adds them to its base, false if the codes run out
+inline bool readValue(BitReader& reader, const ValueBase& base, uint64_t& value){
+    value = base.base;
+    if(base.extraBits > 0){
+        if(reader.bufferedBits() < base.extraBits){
+            reader.refill();
+            if(reader.bufferedBits() < base.extraBits){
+                return false;
+            }
         }
+        value += reader.peek(base.extraBits);
+        reader.consume(base.extraBits);
     }
-
-    int index = 0;
-
-    return recursiveBuildTree(bits, index);
+    return true;
 }
 
-
-std::string decompressFile(const std::string& compressedFile){
-    // first getting the bytes in a vector representation
-    std::vector<uint8_t> binary = readBinaryFile(compressedFile);
-
-    // getting nonce
-    uint8_t nonce[12] = {0};
-    for (int i = 0; i < 12; i++) {
-        uint8_t byte = binary.front();
-        binary.erase(binary.begin());
-        nonce[i] = byte;
+// function that decodes an LZ77 block into buffers.output, data is just past the block's method byte, false if it is damaged
+bool decompressLZ77Block(const uint8_t* data, const uint8_t* end, uint64_t originalSize, uint64_t codesSize, const uint8_t nonce[12],
+                         uint64_t keystreamOffset, BlockBuffers& buffers){
+    if(end - data < 8){
+        return false;
     }
-
-    // getting the size of the metadata
-    uint32_t metadataSize = 0;
-    for (int i = 0; i < 4; i++) {
-        uint8_t byte = binary.front();
-        binary.erase(binary.begin());
-        metadataSize |= (static_cast<uint32_t>(byte) << (8 * i));
+    uint64_t literalCount = loadLittleEndian(data, 4);
+    uint64_t count = loadLittleEndian(data + 4, 4);
+    data += 8;
+    std::array<CodeLengths, 4> lengths;
+    std::array<HuffmanDecoder, 4> decoders;
+    for(int stream = 0; stream < 4; stream++){
+        if(!readCodeLengths(data, end, lengths[stream]) || !decoders[stream].build(lengths[stream])){
+            return false;
+        }
     }
-
-    // parsing the data into real data and metadata
-    std::vector<uint8_t> compressedTree;
-    std::vector<uint8_t> decompressedData;
-
-    for(int i = 0; i < binary.size(); i++){
-        if(i < metadataSize){
-            compressedTree.push_back(binary[i]);
+    // every symbol takes at least a bit and every match covers at least minMatch bytes, and only value symbols have codes
+    if(codesSize != (uint64_t)(end - data) || literalCount > originalSize || count > originalSize / minMatch ||
+       literalCount + 3 * count > codesSize * 8){
+        return false;
+    }
+    for(int stream = 1; stream < 4; stream++){
+        for(uint32_t symbol = valueSymbols; symbol < 256; symbol++){
+            if(lengths[stream][symbol] != 0){
+                return false;
+            }
         }
-        else{
-            decompressedData.push_back(binary[i]);
+    }
+
+    std::vector<uint8_t>& codes = buffers.codes;
+    codes.resize(codesSize);
+    BitReader reader(codes.data(), codes.size());
+    CodeDecryptor decryptor(data, codes, nonce, keystreamOffset);
+    std::vector<uint8_t>& literals = buffers.literals;
+    std::vector<uint8_t>& symbols = buffers.symbols;
+    literals.resize(literalCount + 16);
+    symbols.resize(3 * count);
+    if(!readSymbols(decoders[0], reader, decryptor, literals.data(), literalCount)){
+        return false;
+    }
+    for(int stream = 1; stream < 4; stream++){
+        if(!readSymbols(decoders[stream], reader, decryptor, symbols.data() + (stream - 1) * count, count)){
+            return false;
         }
     }
 
-    // building our tree so we can use it again
-    TreeNode* treeRoot = buildTreeFromVector(compressedTree);
+    // the sequences, with room past the end for literals copied 16 bytes at a time and matches 8 at a time
+    std::vector<uint8_t>& output = buffers.output;
+    output.resize(originalSize + 16);
+    uint8_t* out = output.data();
+    const std::array<ValueBase, valueSymbols>& bases = valueBases();
+    uint64_t position = 0;
+    uint64_t literal = 0;
+    uint64_t lastDistance = 0;
+    for(size_t start = 0; start < count; start += pieceSize){
+        size_t end = std::min<size_t>(count, start + pieceSize);
+        // a sequence's extra bits are never more than 3 * 31
+        decryptor.ahead(reader, (end - start) * 12);
+        for(size_t i = start; i < end; i++){
+            uint64_t run, length, distance;
+            if(!readValue(reader, bases[symbols[i]], run) || !readValue(reader, bases[symbols[count + i]], length) ||
+               !readValue(reader, bases[symbols[2 * count + i]], distance)){
+                return false;
+            }
+            length += minMatch;
+            distance = distance == 0 ? lastDistance : distance;
+            lastDistance = distance;
+            if(run > literalCount - literal || run + length > originalSize - position || distance == 0 || distance > position + run){
+                return false;
+            }
+            // runs are mostly short, a fixed 16 byte copy into the room past the end beats a call for the exact size
+            if(run <= 16){
+                memcpy(out + position, literals.data() + literal, 16);
+            }
+            else{
+                memcpy(out + position, literals.data() + literal, run);
+            }
+            position += run;
+            literal += run;
+
+            uint8_t* copy = out + position;
+            if(distance >= 8){
+                for(uint64_t done = 0; done < length; done += 8){
+                    memcpy(copy + done, copy + done - distance, 8);
+                }
+            }
+            else if(distance == 1){
+                memset(copy, copy[-1], length);
+            }
+            else{
+                for(uint64_t done = 0; done < length; done++){
+                    copy[done] = copy[done - distance];
+                }
+            }
+            position += length;
+        }
+    }
+    // the literals after the last match
+    if(literalCount - literal != originalSize - position){
+        return false;
+    }
+    memcpy(out + position, literals.data() + literal, literalCount - literal);
+    output.resize(originalSize);
+    return true;
+}
 
-    // decrypting the data
-    // encrpyting the data being sent
-    const u_int8_t global_key[32] = {
-        0x50, 0x61, 0x62, 0x6C, 0x6F, 0x20, 0x66, 0x6F,
-        0x72, 0x20, 0x50, 0x72, 0x65, 0x73, 0x69, 0x64,
-        0x65, 0x6E, 0x74, 0x20, 0x6F, 0x66, 0x20, 0x43,
-        0x6F, 0x6C, 0x6F, 0x6D, 0x62, 0x69, 0x61, 0x21
-    };
+// function that decrypts and decodes the block between data and end into buffers.output, false if it is damaged
+// methods is whether the header has the byte saying how the block is coded, version 3 files do not
+bool decompressBlock(const uint8_t* data, const uint8_t* end, uint64_t largestBlock, bool methods, const uint8_t nonce[12], uint64_t keystreamOffset,
+                     BlockBuffers& buffers){
+    if(end - data < 8 + methods){
+        return false;
+    }
+    uint64_t originalSize = loadLittleEndian(data, 4);
+    uint64_t codesSize = loadLittleEndian(data + 4, 4);
+    data += 8;
+    uint8_t method = methods ? *data++ : huffmanBlock;
+    if(originalSize == 0 || originalSize > largestBlock){
+        return false;
+    }
+    if(method == lz77Block){
+        return decompressLZ77Block(data, end, originalSize, codesSize, nonce, keystreamOffset, buffers);
+    }
 
+    // a code takes at least one bit, anything claiming more bytes than that is damaged
+    CodeLengths lengths;
+    HuffmanDecoder decoder;
+    if(method != huffmanBlock || !readCodeLengths(data, end, lengths) || codesSize != (uint64_t)(end - data) ||
+       originalSize > codesSize * 8 || !decoder.build(lengths)){
+        return false;
+    }
 
-    std::vector<uint8_t> decryptedData = encrypt_data(decompressedData, global_key, nonce);
+    std::vector<uint8_t>& codes = buffers.codes;
+    codes.resize(codesSize);
+    buffers.output.resize(originalSize);
+    BitReader reader(codes.data(), codes.size());
+    CodeDecryptor decryptor(data, codes, nonce, keystreamOffset);
+    return readSymbols(decoder, reader, decryptor, buffers.output.data(), originalSize);
+}
 
-    // converting data to a string of bits
-    std::string bitsToDecode = "";
-    for(uint8_t byte: decryptedData){
-        for (int i = 7; i >= 0; --i) {
-            bitsToDecode += ((byte >> i) & 1) ? '1' : '0';
-        }
+// function that decodes the compressed file of size bytes at data into sink, blocks are decoded on the pool and written in order,
+// false if it is damaged or the sink stops, pages of mapping before the blocks done are let go if there is one
+bool decompressBlocks(const uint8_t* data, size_t size, const ByteSink& sink, unsigned threads, MappedFile* mapping){
+    if(size < 36 || memcmp(data, formatMagic, 3) != 0 || (data[3] != huffmanVersion && data[3] != lz77Version)){
+        return false;
     }
+    bool methods = data[3] == lz77Version;
 
-    // decoding using tree
-    std::vector<uint8_t> output;
-    TreeNode* currNode = treeRoot;
+    // getting nonce and the block size
+    const uint8_t* nonce = data + 4;
+    uint64_t largestBlock = loadLittleEndian(data + 16, 4);
 
-    for(char bit: bitsToDecode){
-        if(bit == '0'){
-            currNode = currNode->left;
+    // the index sits at the end, right after the empty block, and says where every block starts
+    uint64_t blocks = loadLittleEndian(data + size - 8, 8);
+    if(blocks > (size - 36) / 8){
+        return false;
+    }
+    uint64_t indexStart = size - 8 - blocks * 8;
+    uint64_t blocksEnd = indexStart - 8;
+    if(loadLittleEndian(data + blocksEnd, 8) != 0){
+        return false;
+    }
+    std::vector<uint64_t> starts(blocks + 1, blocksEnd);
+    for(uint64_t block = 0; block < blocks; block++){
+        starts[block] = loadLittleEndian(data + indexStart + block * 8, 8);
+        if(starts[block] < (block == 0 ? 20 : starts[block - 1] + 8) || starts[block] > blocksEnd){
+            return false;
         }
-        else{
-            currNode = currNode->right;
+    }
+
+    unsigned workers = threadCount(threads);
+    size_t window = 2 * (size_t)workers;
+    std::vector<BlockBuffers> slots(window);
+    std::deque<std::future<void>> pending;
+    ThreadPool pool(workers);
+    bool damaged = false;
+    for(size_t block = 0, submitted = 0; block < blocks && !damaged; block++){
+        for(; submitted < blocks && submitted < block + window; submitted++){
+            pending.push_back(pool.submit([&, submitted]{
+                BlockBuffers& buffers = slots[submitted % window];
+                buffers.decoded = decompressBlock(data + starts[submitted], data + starts[submitted + 1], largestBlock, methods, nonce,
+                                                  submitted * keystreamStride(largestBlock), buffers);
+            }));
         }
+        pending.front().get();
+        pending.pop_front();
 
-        if(currNode->isLeaf()){
-            output.push_back(currNode->val);
-            currNode = treeRoot;
+        BlockBuffers& done = slots[block % window];
+        damaged = !done.decoded || !sink(done.output.data(), done.output.size());
+        if(!damaged && mapping != nullptr){
+            mapping->release(starts[block + 1]);
         }
     }
 
-    // writing back data to the file
+    // blocks still in flight use the slots, so they finish before those go away
+    for(std::future<void>& task: pending){
+        task.get();
+    }
+    return !damaged;
+}
+
+
+bool decompressBuffer(std::span<const uint8_t> input, const ByteSink& sink, unsigned threads){
+    return decompressBlocks(input.data(), input.size(), sink, threads, nullptr);
+}
+
+bool decompressBuffer(std::span<const uint8_t> input, std::vector<uint8_t>& output, unsigned threads){
+    output.clear();
+    return decompressBuffer(input, [&](const uint8_t* data, size_t size){
+        output.insert(output.end(), data, data + size);
+        return true;
+    }, threads);
+}
+
+bool decompressFile(const std::string& compressedFile, const ByteSink& sink, unsigned threads){
+    MappedFile input;
+    return input.open(compressedFile) && decompressBlocks(input.data, input.size, sink, threads, &input);
+}
+
+std::string decompressFile(const std::string& compressedFile, unsigned threads){
+    // writing back data to the file as each block is decoded
     std::string fileName = compressedFile.substr(0, compressedFile.size() - 4) + ".dcmp";
 
     std::ofstream finalFile(fileName, std::ios::binary);
-    finalFile.write(reinterpret_cast<const char*>(output.data()), output.size());
+    bool decoded = decompressFile(compressedFile, [&](const uint8_t* data, size_t size){
+        finalFile.write(reinterpret_cast<const char*>(data), size);
+        return finalFile.good();
+    }, threads);
     finalFile.close();
+    if(!decoded || finalFile.fail()){
+        std::cout << "File " << compressedFile << " could not be opened, is not a compressed file or is damaged, or " << fileName << " could not be written" << std::endl;
+        std::remove(fileName.c_str());
+        return "";
+    }
 
     chmod(fileName.c_str(), 0755);
 
     return fileName;
 }
 
-// benchmarking to get the performance
-void benchmarking(std::vector<std::string> inputs){
-    for(std::string input: inputs){
-        compressFile(input);
+// benchmarking to get the performance, compresses and decompresses each file at each level in MB/s of original bytes,
+// on one thread and on every core
+void benchmarking(const std::vector<std::string>& inputs, const std::vector<int>& levels){
+    std::vector<unsigned> threadCounts = {1};
+    if(threadCount(0) > 1){
+        threadCounts.push_back(threadCount(0));
     }
-}
 
+    for(const std::string& input: inputs){
+        std::vector<uint8_t> original = readBinaryFile(input);
+        double megabytes = original.size() / 1e6;
+        std::cout << input << ": " << original.size() << " bytes" << std::endl;
+        for(int level: levels){
+            for(unsigned threads: threadCounts){
+                // best of a few runs, the first one also pays for reading the file in
+                double compressSeconds = 1e9;
+                double decompressSeconds = 1e9;
+                std::string compressed;
+                std::string decompressed;
+                for(int run = 0; run < 3; run++){
+                    auto start = std::chrono::steady_clock::now();
+                    compressed = compressFile(input, threads, level);
+                    compressSeconds = std::min(compressSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+                    start = std::chrono::steady_clock::now();
+                    decompressed = compressed.empty() ? "" : decompressFile(compressed, threads);
+                    decompressSeconds = std::min(decompressSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+                }
+                if(decompressed.empty()){
+                    return;
+                }
+
+                struct stat info;
+                stat(compressed.c_str(), &info);
+                std::cout << "  level " << level << ", " << threads << (threads == 1 ? " thread " : " threads") << "   compressed to "
+                          << info.st_size << " (" << 100.0 * info.st_size / std::max<size_t>(original.size(), 1) << "%), compress "
+                          << megabytes / compressSeconds << " MB/s, decompress " << megabytes / decompressSeconds << " MB/s" << std::endl;
+                if(original != readBinaryFile(decompressed)){
+                    std::cout << "  round trip does not match" << std::endl;
+                }
+            }
+        }
+    }
+}
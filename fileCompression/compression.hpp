@@ -1,7 +1,38 @@
 #pragma once
+#include <span>
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
 
-std::string compressFile(const std::string& inputExe);
+// Compressed output, or decompressed output, is handed to a sink in order a piece at a time as each block is done,
+// so nothing has to hold all of it. A sink returns false to stop, the call then returns false too.
+using ByteSink = std::function<bool(const uint8_t* data, size_t size)>;
 
-std::string decompressFile(const std::string& compressedFile);
\ No newline at end of file
+// sink that writes everything to fd, a file, pipe, socket or memfd
+ByteSink descriptorSink(int fd);
+
+// blocks are coded on threads threads, 0 uses every core
+// level 0 is Huffman codes of the bytes alone, 1 to 9 find repeats with LZ77 first, searching harder the higher it goes
+constexpr int defaultLevel = 6;
+
+// compresses input into sink, or into a vector that is returned
+bool compressBuffer(std::span<const uint8_t> input, const ByteSink& sink, unsigned threads = 0, int level = defaultLevel);
+std::vector<uint8_t> compressBuffer(std::span<const uint8_t> input, unsigned threads = 0, int level = defaultLevel);
+
+// decompresses input into sink, or into output, false if input is not a compressed file or is damaged
+bool decompressBuffer(std::span<const uint8_t> input, const ByteSink& sink, unsigned threads = 0);
+bool decompressBuffer(std::span<const uint8_t> input, std::vector<uint8_t>& output, unsigned threads = 0);
+
+// writes <inputExe>.cmp and returns its name, empty if it could not
+std::string compressFile(const std::string& inputExe, unsigned threads = 0, int level = defaultLevel);
+
+// writes <name>.dcmp for <name>.cmp, executable, and returns its name, empty if it could not
+std::string decompressFile(const std::string& compressedFile, unsigned threads = 0);
+
+// decompresses a file straight into sink, the file is mapped and read once, false if it can not be
+bool decompressFile(const std::string& compressedFile, const ByteSink& sink, unsigned threads = 0);
+
+// compresses each file at each level and prints the size, compress and decode throughput
+void benchmarking(const std::vector<std::string>& inputs, const std::vector<int>& levels = {0, 1, 4, defaultLevel, 9});
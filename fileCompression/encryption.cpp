@@ -2,7 +2,12 @@
 #include <iostream>
 #include <cstdint>
 #include <cstring>
+#include <algorithm>
 #include "encryption.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHACHA_X86 1
+#endif
 
 const u_int8_t global_key[32] = {
     0x50, 0x61, 0x62, 0x6C, 0x6F, 0x20, 0x66, 0x6F,
@@ -67,29 +72,234 @@ void generate_random_pattern(u_int32_t pattern[16], const u_int32_t key[8], cons
     }
 }
 
-std::vector<uint8_t> encrypt_data(const std::vector<uint8_t>& data, const u_int8_t key[32], const uint8_t nonce[12]) {
-    std::vector<uint8_t> encrypted(data.size());
-    u_int32_t counter = 0;
+// Scalar reference: one 64 byte block of keystream at a time, XORed a byte at a time.
+void chacha_xor_scalar(const u_int8_t* in, u_int8_t* out, size_t size, const u_int32_t key_words[8], const u_int32_t nonce_words[3], u_int32_t& counter, size_t skip) {
+    //Loop through data in blocks of 64 bytes
+    for (size_t i = 0; i < size; skip = 0) {
+        u_int32_t pattern[16];
+        generate_random_pattern(pattern, key_words, nonce_words, counter++);
 
-    u_int32_t key_words[8];
-    u_int32_t nonce_words[3];
+        // XOR the data with the generated pattern
+        for (size_t j = skip; j < 64 && i < size; ++j, ++i) {
+            out[i] = in[i] ^ ((uint8_t *)pattern)[j];
+        }
+    }
+}
+
+#ifdef CHACHA_X86
+// The vector versions keep word i of 4 (SSE2) or 8 (AVX2) blocks in one register, block n of the group in lane n, so
+// every instruction of the rounds works on all of them at once. At the end the lanes are transposed back into blocks
+// and XORed with the input 16 or 32 bytes at a time.
+
+template <int shift>
+__attribute__((target("sse2"))) inline __m128i rotate_sse2(__m128i input) {
+    return _mm_or_si128(_mm_slli_epi32(input, shift), _mm_srli_epi32(input, 32 - shift));
+}
+
+__attribute__((target("sse2"))) inline void update_constants_sse2(__m128i& a, __m128i& b, __m128i& c, __m128i& d) {
+    a = _mm_add_epi32(a, b);
+    d = rotate_sse2<16>(_mm_xor_si128(d, a));
+    c = _mm_add_epi32(c, d);
+    b = rotate_sse2<12>(_mm_xor_si128(b, c));
+    a = _mm_add_epi32(a, b);
+    d = rotate_sse2<8>(_mm_xor_si128(d, a));
+    c = _mm_add_epi32(c, d);
+    b = rotate_sse2<7>(_mm_xor_si128(b, c));
+}
+
+// Whole groups of 4 blocks, groups * 256 bytes.
+__attribute__((target("sse2")))
+void chacha_xor_sse2(const u_int8_t* in, u_int8_t* out, size_t groups, const u_int32_t key_words[8], const u_int32_t nonce_words[3], u_int32_t& counter) {
+    const uint32_t constants[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+    __m128i state[16];
+    for (int i = 0; i < 4; ++i) {
+        state[i] = _mm_set1_epi32(constants[i]);
+    }
     for (int i = 0; i < 8; ++i) {
-        key_words[i] = ((uint32_t *)key)[i];
+        state[4 + i] = _mm_set1_epi32(key_words[i]);
     }
     for (int i = 0; i < 3; ++i) {
-        nonce_words[i] = ((uint32_t *)nonce)[i];
+        state[13 + i] = _mm_set1_epi32(nonce_words[i]);
     }
 
-    //Loop through data in blocks of 64 bytes
-    for (size_t i = 0; i < data.size(); i += 64) {
-        u_int32_t pattern[16];
-        generate_random_pattern(pattern, key_words, nonce_words, counter++);
+    for (size_t group = 0; group < groups; ++group, in += 256, out += 256, counter += 4) {
+        state[12] = _mm_add_epi32(_mm_set1_epi32(counter), _mm_setr_epi32(0, 1, 2, 3));
+        __m128i x[16];
+        for (int i = 0; i < 16; ++i) {
+            x[i] = state[i];
+        }
 
-        // XOR the data with the generated pattern
-        for (size_t j = 0; j < 64 && (i + j) < data.size(); ++j) {
-            encrypted[i + j] = data[i + j] ^ ((uint8_t *)pattern)[j];
+        for (int i = 0; i < 10; i++) {
+            update_constants_sse2(x[0], x[4], x[8], x[12]);
+            update_constants_sse2(x[1], x[5], x[9], x[13]);
+            update_constants_sse2(x[2], x[6], x[10], x[14]);
+            update_constants_sse2(x[3], x[7], x[11], x[15]);
+
+            update_constants_sse2(x[0], x[5], x[10], x[15]);
+            update_constants_sse2(x[1], x[6], x[11], x[12]);
+            update_constants_sse2(x[2], x[7], x[8], x[13]);
+            update_constants_sse2(x[3], x[4], x[9], x[14]);
+        }
+
+        for (int i = 0; i < 16; ++i) {
+            x[i] = _mm_add_epi32(x[i], state[i]);
+        }
+
+        // words 4g to 4g + 3 of the 4 blocks, transposed so each register holds 16 bytes of one block
+        for (int g = 0; g < 4; ++g) {
+            __m128i low01 = _mm_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+            __m128i low23 = _mm_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m128i high01 = _mm_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+            __m128i high23 = _mm_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m128i blocks[4] = {
+                _mm_unpacklo_epi64(low01, low23), _mm_unpackhi_epi64(low01, low23),
+                _mm_unpacklo_epi64(high01, high23), _mm_unpackhi_epi64(high01, high23)
+            };
+            for (int block = 0; block < 4; ++block) {
+                size_t at = block * 64 + g * 16;
+                __m128i data = _mm_loadu_si128((const __m128i*)(in + at));
+                _mm_storeu_si128((__m128i*)(out + at), _mm_xor_si128(data, blocks[block]));
+            }
         }
     }
+}
+
+template <int shift>
+__attribute__((target("avx2"))) inline __m256i rotate_avx2(__m256i input) {
+    return _mm256_or_si256(_mm256_slli_epi32(input, shift), _mm256_srli_epi32(input, 32 - shift));
+}
+
+__attribute__((target("avx2"))) inline void update_constants_avx2(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i rotate16, __m256i rotate8) {
+    // rotations by whole bytes are a single byte shuffle
+    a = _mm256_add_epi32(a, b);
+    d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rotate16);
+    c = _mm256_add_epi32(c, d);
+    b = rotate_avx2<12>(_mm256_xor_si256(b, c));
+    a = _mm256_add_epi32(a, b);
+    d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rotate8);
+    c = _mm256_add_epi32(c, d);
+    b = rotate_avx2<7>(_mm256_xor_si256(b, c));
+}
 
+// Whole groups of 8 blocks, groups * 512 bytes.
+__attribute__((target("avx2")))
+void chacha_xor_avx2(const u_int8_t* in, u_int8_t* out, size_t groups, const u_int32_t key_words[8], const u_int32_t nonce_words[3], u_int32_t& counter) {
+    const uint32_t constants[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+    const __m256i rotate16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                              2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rotate8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                             3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    __m256i state[16];
+    for (int i = 0; i < 4; ++i) {
+        state[i] = _mm256_set1_epi32(constants[i]);
+    }
+    for (int i = 0; i < 8; ++i) {
+        state[4 + i] = _mm256_set1_epi32(key_words[i]);
+    }
+    for (int i = 0; i < 3; ++i) {
+        state[13 + i] = _mm256_set1_epi32(nonce_words[i]);
+    }
+
+    for (size_t group = 0; group < groups; ++group, in += 512, out += 512, counter += 8) {
+        state[12] = _mm256_add_epi32(_mm256_set1_epi32(counter), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256i x[16];
+        for (int i = 0; i < 16; ++i) {
+            x[i] = state[i];
+        }
+
+        for (int i = 0; i < 10; i++) {
+            update_constants_avx2(x[0], x[4], x[8], x[12], rotate16, rotate8);
+            update_constants_avx2(x[1], x[5], x[9], x[13], rotate16, rotate8);
+            update_constants_avx2(x[2], x[6], x[10], x[14], rotate16, rotate8);
+            update_constants_avx2(x[3], x[7], x[11], x[15], rotate16, rotate8);
+
+            update_constants_avx2(x[0], x[5], x[10], x[15], rotate16, rotate8);
+            update_constants_avx2(x[1], x[6], x[11], x[12], rotate16, rotate8);
+            update_constants_avx2(x[2], x[7], x[8], x[13], rotate16, rotate8);
+            update_constants_avx2(x[3], x[4], x[9], x[14], rotate16, rotate8);
+        }
+
+        for (int i = 0; i < 16; ++i) {
+            x[i] = _mm256_add_epi32(x[i], state[i]);
+        }
+
+        // the same transpose as SSE2 inside each 128 bit half leaves words 4g to 4g + 3 of block n in the low half
+        // and of block n + 4 in the high half, pairs of those halves make 32 bytes of one block
+        __m256i words[4][4];
+        for (int g = 0; g < 4; ++g) {
+            __m256i low01 = _mm256_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+            __m256i low23 = _mm256_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m256i high01 = _mm256_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+            __m256i high23 = _mm256_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+            words[g][0] = _mm256_unpacklo_epi64(low01, low23);
+            words[g][1] = _mm256_unpackhi_epi64(low01, low23);
+            words[g][2] = _mm256_unpacklo_epi64(high01, high23);
+            words[g][3] = _mm256_unpackhi_epi64(high01, high23);
+        }
+        for (int block = 0; block < 4; ++block) {
+            for (int half = 0; half < 2; ++half) {
+                __m256i low = _mm256_permute2x128_si256(words[2 * half][block], words[2 * half + 1][block], 0x20);
+                __m256i high = _mm256_permute2x128_si256(words[2 * half][block], words[2 * half + 1][block], 0x31);
+                size_t at = block * 64 + half * 32;
+                __m256i data = _mm256_loadu_si256((const __m256i*)(in + at));
+                _mm256_storeu_si256((__m256i*)(out + at), _mm256_xor_si256(data, low));
+                data = _mm256_loadu_si256((const __m256i*)(in + at + 256));
+                _mm256_storeu_si256((__m256i*)(out + at + 256), _mm256_xor_si256(data, high));
+            }
+        }
+    }
+}
+#endif
+
+chacha_path chacha_best_path() {
+    static const chacha_path best = [] {
+#ifdef CHACHA_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return CHACHA_AVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return CHACHA_SSE2;
+        }
+#endif
+        return CHACHA_SCALAR;
+    }();
+    return best;
+}
+
+void chacha_xor(const u_int8_t* in, u_int8_t* out, size_t size, const u_int8_t key[32], const u_int8_t nonce[12], uint64_t offset, chacha_path path) {
+    u_int32_t key_words[8];
+    u_int32_t nonce_words[3];
+    memcpy(key_words, key, 32);
+    memcpy(nonce_words, nonce, 12);
+
+    // the keystream picks up at offset, part way into a 64 byte block if need be
+    u_int32_t counter = (u_int32_t)(offset / 64);
+    size_t skip = offset % 64;
+    size_t done = 0;
+    if (skip > 0) {
+        done = std::min(size, 64 - skip);
+        chacha_xor_scalar(in, out, done, key_words, nonce_words, counter, skip);
+    }
+
+    // whole blocks as wide as the CPU goes, whatever is left over is done by the narrower ones
+#ifdef CHACHA_X86
+    if (path == CHACHA_AVX2 && chacha_best_path() == CHACHA_AVX2) {
+        size_t groups = (size - done) / 512;
+        chacha_xor_avx2(in + done, out + done, groups, key_words, nonce_words, counter);
+        done += groups * 512;
+    }
+    if (path != CHACHA_SCALAR && chacha_best_path() != CHACHA_SCALAR) {
+        size_t groups = (size - done) / 256;
+        chacha_xor_sse2(in + done, out + done, groups, key_words, nonce_words, counter);
+        done += groups * 256;
+    }
+#endif
+    chacha_xor_scalar(in + done, out + done, size - done, key_words, nonce_words, counter, 0);
+}
+
+std::vector<uint8_t> encrypt_data(const std::vector<uint8_t>& data, const u_int8_t key[32], const uint8_t nonce[12], uint64_t offset) {
+    std::vector<uint8_t> encrypted(data.size());
+    chacha_xor(data.data(), encrypted.data(), data.size(), key, nonce, offset, chacha_best_path());
     return encrypted;
-}
\ No newline at end of file
+}
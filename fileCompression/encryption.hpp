@@ -1,5 +1,8 @@
 #pragma once
 #include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
 
 // This encryption algorithm is symmetric, encrypt the encrypted data with the same key and nonce to decrypt it.
 
@@ -7,4 +10,18 @@
 
 // The nonce is an array of 12 uint8_t that should be generated with a pseudorandom generator or a hash of the file.
 
-std::vector<u_int8_t> encrypt_data(const std::vector<u_int8_t>& data, const u_int8_t key[32], const u_int8_t nonce[12]);
\ No newline at end of file
+// Offset is where in the keystream the data starts, so data encrypted in pieces matches encrypting it all at once.
+
+std::vector<u_int8_t> encrypt_data(const std::vector<u_int8_t>& data, const u_int8_t key[32], const u_int8_t nonce[12], uint64_t offset = 0);
+
+// The keystream is made 8 blocks at a time with AVX2 or 4 at a time with SSE2 when the CPU has them (checked with CPUID
+// once), and one at a time otherwise; all three give the same bytes, the one block at a time code is the reference.
+
+enum chacha_path { CHACHA_SCALAR, CHACHA_SSE2, CHACHA_AVX2 };
+
+// The widest path this CPU can run.
+chacha_path chacha_best_path();
+
+// XORs size bytes of keystream from offset on into out, in and out can be the same buffer to encrypt in place.
+// A path wider than the CPU supports falls back to the widest one it does.
+void chacha_xor(const u_int8_t* in, u_int8_t* out, size_t size, const u_int8_t key[32], const u_int8_t nonce[12], uint64_t offset, chacha_path path);
@@ -0,0 +1,105 @@
+// importing necessary things
+#include "encryption.hpp"
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+// known answer test and throughput for the ChaCha20 paths
+// g++ -std=c++20 -O2 encryptionKAT.cpp encryption.cpp -o encryptionKAT
+// ./encryptionKAT
+// prints PASS or FAIL for each check and GB/s for each path this CPU has, exits with 1 if anything failed
+
+
+const char* pathName(chacha_path path){
+    return path == CHACHA_AVX2 ? "avx2" : path == CHACHA_SSE2 ? "sse2" : "scalar";
+}
+
+int failures = 0;
+
+void report(const std::string& name, bool passed){
+    std::cout << (passed ? "PASS " : "FAIL ") << name << std::endl;
+    failures += !passed;
+}
+
+int main(){
+    std::vector<chacha_path> paths = {CHACHA_SCALAR};
+    if(chacha_best_path() >= CHACHA_SSE2){
+        paths.push_back(CHACHA_SSE2);
+    }
+    if(chacha_best_path() >= CHACHA_AVX2){
+        paths.push_back(CHACHA_AVX2);
+    }
+
+    // RFC 8439 section 2.4.2, key 00 01 .. 1f, counter 1
+    uint8_t key[32];
+    for(int i = 0; i < 32; i++){
+        key[i] = (uint8_t)i;
+    }
+    const uint8_t nonce[12] = {0, 0, 0, 0, 0, 0, 0, 0x4a, 0, 0, 0, 0};
+    const std::string plaintext = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+    const uint8_t ciphertext[114] = {
+        0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80, 0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81,
+        0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2, 0x0a, 0x27, 0xaf, 0xcc, 0xfd, 0x9f, 0xae, 0x0b,
+        0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab, 0x8f, 0x59, 0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57,
+        0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab, 0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8,
+        0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d, 0x6a, 0x61, 0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e,
+        0x52, 0xbc, 0x51, 0x4d, 0x16, 0xcc, 0xf8, 0x06, 0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36,
+        0x5a, 0xf9, 0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6, 0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+        0x87, 0x4d
+    };
+    for(chacha_path path: paths){
+        std::vector<uint8_t> out(plaintext.size());
+        chacha_xor((const uint8_t*)plaintext.data(), out.data(), out.size(), key, nonce, 64, path);
+        report(std::string("rfc8439 2.4.2 ") + pathName(path), memcmp(out.data(), ciphertext, sizeof(ciphertext)) == 0);
+    }
+
+    // the vector paths only take whole groups of 4 or 8 blocks, so they are checked against the reference over sizes and
+    // offsets that start and end part way into blocks and groups, and across the 32 bit counter wrapping
+    std::vector<uint8_t> input(70000);
+    for(size_t i = 0; i < input.size(); i++){
+        input[i] = (uint8_t)(i * 131 + (i >> 8));
+    }
+    const size_t sizes[] = {0, 1, 63, 64, 65, 255, 256, 257, 511, 512, 513, 1000, 4096, 65539};
+    const uint64_t offsets[] = {0, 1, 63, 64, 100, 64 * 7 + 5, 64 * 13, ((1ULL << 32) - 5) * 64 + 17};
+    for(chacha_path path: paths){
+        if(path == CHACHA_SCALAR){
+            continue;
+        }
+        bool same = true;
+        for(size_t size: sizes){
+            for(uint64_t offset: offsets){
+                std::vector<uint8_t> expected(size), out(size), inPlace(input.begin(), input.begin() + size);
+                chacha_xor(input.data(), expected.data(), size, key, nonce, offset, CHACHA_SCALAR);
+                chacha_xor(input.data(), out.data(), size, key, nonce, offset, path);
+                chacha_xor(inPlace.data(), inPlace.data(), size, key, nonce, offset, path);
+                same = same && out == expected && inPlace == expected;
+            }
+        }
+        report(std::string("matches scalar ") + pathName(path), same);
+    }
+
+    // encrypt_data is what the compressor calls, it must match the reference too
+    std::vector<uint8_t> expected(input.size());
+    chacha_xor(input.data(), expected.data(), input.size(), key, nonce, 3, CHACHA_SCALAR);
+    report("encrypt_data matches scalar", encrypt_data(input, key, nonce, 3) == expected);
+
+    // throughput, encrypting in place over a buffer bigger than the caches
+    std::vector<uint8_t> buffer(64 << 20, 1);
+    for(chacha_path path: paths){
+        int runs = 0;
+        auto start = std::chrono::steady_clock::now();
+        double seconds = 0;
+        while(seconds < 0.5){
+            chacha_xor(buffer.data(), buffer.data(), buffer.size(), key, nonce, 0, path);
+            runs++;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        std::cout << std::left << std::setw(7) << pathName(path) << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(7) << buffer.size() * (double)runs / seconds / 1e9 << " GB/s" << std::endl;
+    }
+
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+// importing necessary things
+#include "histogram.hpp"
+#include <cstring>
+#include <algorithm>
+
+
+// 8 tables of 32 bit counts, 8 KB in all so they stay in the L1 cache
+using CountTables = uint32_t[8][256];
+
+// the 32 bit counts could overflow past this, so longer inputs are counted a piece at a time
+constexpr size_t largestPiece = (size_t)1 << 31;
+
+// function that counts 8 bytes at a time, each one into its own table
+// the increments are written out, GCC makes a loop over the tables half as fast
+void countInterleaved(const uint8_t* data, size_t size, CountTables& counts){
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8){
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        counts[0][word & 0xff]++;
+        counts[1][(word >> 8) & 0xff]++;
+        counts[2][(word >> 16) & 0xff]++;
+        counts[3][(word >> 24) & 0xff]++;
+        counts[4][(word >> 32) & 0xff]++;
+        counts[5][(word >> 40) & 0xff]++;
+        counts[6][(word >> 48) & 0xff]++;
+        counts[7][word >> 56]++;
+    }
+    for(; i < size; i++){
+        counts[0][data[i]]++;
+    }
+}
+
+std::array<uint64_t, 256> byteHistogram(const uint8_t* data, size_t size){
+    std::array<uint64_t, 256> frequencies = {};
+    CountTables counts;
+    for(size_t start = 0; start < size; start += largestPiece){
+        memset(counts, 0, sizeof(counts));
+        countInterleaved(data + start, std::min(largestPiece, size - start), counts);
+        for(int byte = 0; byte < 256; byte++){
+            for(int table = 0; table < 8; table++){
+                frequencies[byte] += counts[table][byte];
+            }
+        }
+    }
+    return frequencies;
+}
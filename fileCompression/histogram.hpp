@@ -0,0 +1,11 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// Byte histograms for building Huffman codes.
+// Counts go into 8 tables taken in turn, so a run of the same byte does not have every increment wait on the one
+// before it through memory, and the tables are summed at the end.
+
+// how often each byte appears
+std::array<uint64_t, 256> byteHistogram(const uint8_t* data, size_t size);
@@ -0,0 +1,149 @@
+// importing necessary things
+#include "histogram.hpp"
+#include <array>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <iostream>
+#include <functional>
+#include <cstring>
+#include <unordered_map>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BENCH_AVX2 1
+#endif
+
+// microbenchmark for the byte histogram, on real executables
+// g++ -std=c++20 -O2 histogramBench.cpp histogram.cpp -o histogramBench
+// ./histogramBench [<file>...]     with no files it measures itself
+// prints MB/s of each way of counting on each file and checks they all agree
+// the AVX2 variant is not used by the compressor: counting is bound by one table store per byte, which vectors do not help
+// with, and the runs of one byte it skips are only a few percent of an executable, so it comes out the same or a little slower
+
+
+// the frequency count compressFile used to have, a hash lookup and insert for every byte
+std::unordered_map<uint8_t, uint64_t> findFrequencyMap(const std::vector<uint8_t>& binaryFile){
+    std::unordered_map<uint8_t, uint64_t> frequencyMap = {};
+    for(uint8_t byte: binaryFile){
+        if(frequencyMap.find(byte) == frequencyMap.end()){
+            frequencyMap[byte] = 1;
+        }
+        else{
+            frequencyMap[byte] += 1;
+        }
+    }
+    return frequencyMap;
+}
+
+// one flat table, every increment of a repeated byte waits on the last one
+std::array<uint64_t, 256> findFrequencyFlat(const uint8_t* data, size_t size){
+    std::array<uint64_t, 256> frequencies = {};
+    for(size_t i = 0; i < size; i++){
+        frequencies[data[i]]++;
+    }
+    return frequencies;
+}
+
+#ifdef BENCH_AVX2
+// 8 tables as well, but 32 bytes of one repeated byte (zero fill, padding) are checked for first and counted with one add
+__attribute__((target("avx2")))
+std::array<uint64_t, 256> findFrequencyRunsAVX2(const uint8_t* data, size_t size){
+    uint32_t counts[8][256];
+    memset(counts, 0, sizeof(counts));
+    size_t i = 0;
+    for(; i + 32 <= size; i += 32){
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(data + i));
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8((char)data[i]))) == -1){
+            counts[0][data[i]] += 32;
+            continue;
+        }
+        for(size_t j = 0; j < 32; j += 8){
+            uint64_t word;
+            memcpy(&word, data + i + j, 8);
+            counts[0][word & 0xff]++;
+            counts[1][(word >> 8) & 0xff]++;
+            counts[2][(word >> 16) & 0xff]++;
+            counts[3][(word >> 24) & 0xff]++;
+            counts[4][(word >> 32) & 0xff]++;
+            counts[5][(word >> 40) & 0xff]++;
+            counts[6][(word >> 48) & 0xff]++;
+            counts[7][word >> 56]++;
+        }
+    }
+    for(; i < size; i++){
+        counts[0][data[i]]++;
+    }
+    std::array<uint64_t, 256> frequencies = {};
+    for(int byte = 0; byte < 256; byte++){
+        for(int table = 0; table < 8; table++){
+            frequencies[byte] += counts[table][byte];
+        }
+    }
+    return frequencies;
+}
+#endif
+
+// function that runs count until a quarter second has gone by and returns MB/s
+double measure(size_t size, const std::function<void()>& count){
+    int runs = 0;
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0;
+    while(seconds < 0.25){
+        count();
+        runs++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return size * (double)runs / seconds / 1e6;
+}
+
+int main(int argc, char* argv[]){
+    std::vector<std::string> files(argv + 1, argv + argc);
+    if(files.empty()){
+        files.push_back("/proc/self/exe");
+    }
+    bool avx2Available = false;
+#ifdef BENCH_AVX2
+    __builtin_cpu_init();
+    avx2Available = __builtin_cpu_supports("avx2");
+#endif
+
+    for(const std::string& file: files){
+        std::ifstream input(file, std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(input)), {});
+        if(data.empty()){
+            std::cout << file << ": could not be read or is empty" << std::endl;
+            continue;
+        }
+
+        std::unordered_map<uint8_t, uint64_t> map;
+        std::array<uint64_t, 256> flat, tables, avx2;
+        double mapSpeed = measure(data.size(), [&]{ map = findFrequencyMap(data); });
+        double flatSpeed = measure(data.size(), [&]{ flat = findFrequencyFlat(data.data(), data.size()); });
+        double tablesSpeed = measure(data.size(), [&]{ tables = byteHistogram(data.data(), data.size()); });
+        double avx2Speed = 0;
+        avx2 = tables;
+#ifdef BENCH_AVX2
+        if(avx2Available){
+            avx2Speed = measure(data.size(), [&]{ avx2 = findFrequencyRunsAVX2(data.data(), data.size()); });
+        }
+#endif
+
+        bool agree = flat == tables && flat == avx2;
+        for(int byte = 0; byte < 256; byte++){
+            agree = agree && (map.count(byte) ? map[byte] : 0) == flat[byte];
+        }
+
+        std::cout << file << ": " << data.size() << " bytes" << (agree ? "" : ", counts do not agree") << std::endl;
+        std::cout << std::fixed << std::setprecision(0)
+                  << "  unordered_map      " << std::setw(8) << mapSpeed << " MB/s" << std::endl
+                  << "  one table          " << std::setw(8) << flatSpeed << " MB/s" << std::endl
+                  << "  8 tables           " << std::setw(8) << tablesSpeed << " MB/s" << std::endl;
+        if(avx2Available){
+            std::cout << "  8 tables + AVX2    " << std::setw(8) << avx2Speed << " MB/s" << std::endl;
+        }
+    }
+    return 0;
+}
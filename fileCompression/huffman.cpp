@@ -0,0 +1,334 @@
+// importing necessary things
+#include "huffman.hpp"
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+
+
+// function that builds code lengths with the usual Huffman tree, kept in flat arrays instead of allocated nodes
+CodeLengths buildCodeLengths(const std::array<uint64_t, 256>& frequencies, uint32_t maxLength){
+    CodeLengths lengths = {};
+
+    // leaves come first and internal nodes after them in the order they are made, so a parent is always after its children
+    std::array<uint8_t, 256> symbolOf = {};
+    std::array<uint32_t, 511> parent = {};
+    std::priority_queue<std::pair<uint64_t, uint32_t>, std::vector<std::pair<uint64_t, uint32_t>>, std::greater<>> minHeap;
+    uint32_t leaves = 0;
+    for(uint32_t byte = 0; byte < 256; byte++){
+        if(frequencies[byte] > 0){
+            symbolOf[leaves] = (uint8_t)byte;
+            minHeap.push({frequencies[byte], leaves++});
+        }
+    }
+
+    if(leaves == 0){
+        return lengths;
+    }
+    if(leaves == 1){
+        // a code needs at least one bit, even when there is nothing to tell apart
+        lengths[symbolOf[0]] = 1;
+        return lengths;
+    }
+
+    // building the tree
+    uint32_t nodes = leaves;
+    while(minHeap.size() > 1){
+        auto left = minHeap.top();
+        minHeap.pop();
+        auto right = minHeap.top();
+        minHeap.pop();
+
+        parent[left.second] = nodes;
+        parent[right.second] = nodes;
+        minHeap.push({left.first + right.first, nodes++});
+    }
+
+    // depths from the root down, the root is the last node made
+    std::array<uint32_t, 511> depth = {};
+    uint32_t longest = 0;
+    for(int node = (int)nodes - 2; node >= 0; node--){
+        depth[node] = depth[parent[node]] + 1;
+    }
+    std::array<uint32_t, 256> countOfLength = {};
+    for(uint32_t leaf = 0; leaf < leaves; leaf++){
+        longest = std::max(longest, depth[leaf]);
+        // anything deeper than maxLength is counted at maxLength for now
+        countOfLength[std::min(depth[leaf], maxLength)]++;
+        lengths[symbolOf[leaf]] = (uint8_t)std::min(depth[leaf], maxLength);
+    }
+    if(longest <= maxLength){
+        return lengths;
+    }
+
+    // the cut down codes no longer fit, so one code at maxLength at a time is dropped and a shorter one is split in two
+    // to take its place, until the lengths add up to a full code again (the same fix zlib style encoders use)
+    uint64_t total = 0;
+    for(uint32_t length = 1; length <= maxLength; length++){
+        total += (uint64_t)countOfLength[length] << (maxLength - length);
+    }
+    while(total > (1ULL << maxLength)){
+        countOfLength[maxLength]--;
+        for(uint32_t length = maxLength - 1; length > 0; length--){
+            if(countOfLength[length] > 0){
+                countOfLength[length]--;
+                countOfLength[length + 1] += 2;
+                break;
+            }
+        }
+        total--;
+    }
+
+    // handing the lengths back out, shortest to the most frequent bytes
+    std::array<uint8_t, 256> byFrequency;
+    std::copy(symbolOf.begin(), symbolOf.begin() + leaves, byFrequency.begin());
+    std::sort(byFrequency.begin(), byFrequency.begin() + leaves, [&](uint8_t l, uint8_t r){
+        return frequencies[l] != frequencies[r] ? frequencies[l] > frequencies[r] : l < r;
+    });
+    uint32_t next = 0;
+    for(uint32_t length = 1; length <= maxLength; length++){
+        for(uint32_t i = 0; i < countOfLength[length]; i++){
+            lengths[byFrequency[next++]] = (uint8_t)length;
+        }
+    }
+
+    return lengths;
+}
+
+// function that gives each length its first code, codes of one length follow each other and the next length starts after them
+std::array<uint32_t, maxCodeLength + 1> firstCodes(const std::array<uint32_t, maxCodeLength + 1>& counts){
+    std::array<uint32_t, maxCodeLength + 1> first = {};
+    uint32_t code = 0;
+    for(uint32_t length = 1; length <= maxCodeLength; length++){
+        code = (code + counts[length - 1]) << 1;
+        first[length] = code;
+    }
+    return first;
+}
+
+// function that returns the canonical code of every byte
+std::array<Code, 256> canonicalCodes(const CodeLengths& lengths){
+    std::array<uint32_t, maxCodeLength + 1> counts = {};
+    for(uint8_t length: lengths){
+        if(length > 0){
+            counts[length]++;
+        }
+    }
+
+    std::array<uint32_t, maxCodeLength + 1> next = firstCodes(counts);
+    std::array<Code, 256> codes = {};
+    for(uint32_t byte = 0; byte < 256; byte++){
+        if(lengths[byte] > 0){
+            codes[byte] = {next[lengths[byte]]++, lengths[byte]};
+        }
+    }
+    return codes;
+}
+
+// function that writes the code lengths in whichever of the two layouts is shorter
+void writeCodeLengths(const CodeLengths& lengths, std::vector<uint8_t>& output){
+    uint32_t used = 0;
+    for(uint8_t length: lengths){
+        used += length > 0;
+    }
+    output.push_back((uint8_t)used);
+    output.push_back((uint8_t)(used >> 8));
+
+    if(used * 2 <= 128){
+        for(uint32_t byte = 0; byte < 256; byte++){
+            if(lengths[byte] > 0){
+                output.push_back((uint8_t)byte);
+                output.push_back(lengths[byte]);
+            }
+        }
+    }
+    else{
+        for(uint32_t byte = 0; byte < 256; byte += 2){
+            output.push_back((uint8_t)(lengths[byte] << 4 | lengths[byte + 1]));
+        }
+    }
+}
+
+size_t codeLengthsSize(const CodeLengths& lengths){
+    uint32_t used = 0;
+    for(uint8_t length: lengths){
+        used += length > 0;
+    }
+    return 2 + (used * 2 <= 128 ? used * 2 : 128);
+}
+
+// function that checks the lengths can be a prefix code, no code longer than maxCodeLength and no more codes than fit
+bool validLengths(const CodeLengths& lengths){
+    uint64_t total = 0;
+    for(uint8_t length: lengths){
+        if(length > maxCodeLength){
+            return false;
+        }
+        if(length > 0){
+            total += 1ULL << (maxCodeLength - length);
+        }
+    }
+    return total <= (1ULL << maxCodeLength);
+}
+
+// function that reads the code lengths back
+bool readCodeLengths(const uint8_t*& data, const uint8_t* end, CodeLengths& lengths){
+    lengths = {};
+    if(end - data < 2){
+        return false;
+    }
+    uint32_t used = data[0] | (uint32_t)data[1] << 8;
+    data += 2;
+    if(used > 256){
+        return false;
+    }
+
+    if(used * 2 <= 128){
+        if((size_t)(end - data) < used * 2){
+            return false;
+        }
+        for(uint32_t i = 0; i < used; i++){
+            uint8_t byte = data[2 * i];
+            uint8_t length = data[2 * i + 1];
+            // a byte listed twice or without a code means the header is damaged
+            if(length == 0 || lengths[byte] != 0){
+                return false;
+            }
+            lengths[byte] = length;
+        }
+        data += used * 2;
+    }
+    else{
+        if(end - data < 128){
+            return false;
+        }
+        uint32_t found = 0;
+        for(uint32_t i = 0; i < 128; i++){
+            lengths[2 * i] = data[i] >> 4;
+            lengths[2 * i + 1] = data[i] & 15;
+            found += (lengths[2 * i] > 0) + (lengths[2 * i + 1] > 0);
+        }
+        data += 128;
+        if(found != used){
+            return false;
+        }
+    }
+
+    return validLengths(lengths);
+}
+
+bool HuffmanDecoder::build(const CodeLengths& lengths){
+    if(!validLengths(lengths)){
+        return false;
+    }
+
+    // bytes sorted by code, shortest first and by byte within a length, is the order their codes were handed out in
+    counts = {};
+    for(uint8_t length: lengths){
+        if(length > 0){
+            counts[length]++;
+        }
+    }
+    firstCode = firstCodes(counts);
+    offsets = {};
+    for(uint32_t length = 1; length < maxCodeLength; length++){
+        offsets[length + 1] = offsets[length] + counts[length];
+    }
+    std::array<uint32_t, maxCodeLength + 1> placed = offsets;
+    for(uint32_t byte = 0; byte < 256; byte++){
+        if(lengths[byte] > 0){
+            sorted[placed[lengths[byte]]++] = (uint8_t)byte;
+        }
+    }
+
+    // first every short code fills the entries that start with it
+    std::array<Entry, 1 << lookupBits> single = {};
+    std::array<Code, 256> codes = canonicalCodes(lengths);
+    for(uint32_t byte = 0; byte < 256; byte++){
+        uint32_t length = codes[byte].length;
+        if(length == 0 || length > lookupBits){
+            continue;
+        }
+        uint32_t start = (uint32_t)codes[byte].bits << (lookupBits - length);
+        for(uint32_t index = start; index < start + (1u << (lookupBits - length)); index++){
+            single[index] = {{(uint8_t)byte}, 1, (uint8_t)length};
+        }
+    }
+
+    // then each entry takes on the codes that follow while they end inside the same lookupBits bits
+    // the bits past the first code are looked up with zeros shifted in, which only matters for codes too long to be taken
+    constexpr uint32_t mask = (1u << lookupBits) - 1;
+    for(uint32_t index = 0; index <= mask; index++){
+        Entry entry = single[index];
+        while(entry.count > 0 && entry.count < 4){
+            const Entry& next = single[(index << entry.length) & mask];
+            if(next.count == 0 || entry.length + next.length > lookupBits){
+                break;
+            }
+            entry.symbols[entry.count++] = next.symbols[0];
+            entry.length += next.length;
+        }
+        entries[index] = entry;
+    }
+
+    return true;
+}
+
+// function that decodes one byte by trying each code length in turn, used for long codes and the end of the input
+bool HuffmanDecoder::decodeOne(BitReader& reader, uint8_t& symbol) const{
+    reader.refill();
+    for(uint32_t length = 1; length <= maxCodeLength; length++){
+        if(length > reader.bitsLeft()){
+            return false;
+        }
+        uint32_t index = (uint32_t)reader.peek(length) - firstCode[length];
+        if(index < counts[length]){
+            symbol = sorted[offsets[length] + index];
+            reader.consume(length);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HuffmanDecoder::decode(BitReader& reader, uint8_t* output, size_t count) const{
+    // a code takes at least one bit, so one refill of up to 63 bits never decodes to more than 63 bytes plus the 4 stored per lookup
+    // the table loop stops this far from the end so those stores stay inside the output
+    constexpr size_t room = 68;
+    size_t position = 0;
+
+    while(position + room <= count){
+        // a refill leaves at least 56 bits, so several lookups go by before the next one
+        reader.refill();
+        uint8_t* out = output + position;
+        while(reader.bufferedBits() >= lookupBits){
+            const Entry& entry = entries[reader.peek(lookupBits)];
+            if(entry.count == 0){
+                break;
+            }
+            // 4 symbols are always stored, only count of them are kept
+            memcpy(out, entry.symbols, 4);
+            out += entry.count;
+            reader.consume(entry.length);
+        }
+        position = out - output;
+
+        if(reader.bufferedBits() >= lookupBits){
+            // long code
+            if(!decodeOne(reader, output[position++])){
+                return false;
+            }
+        }
+        else if(reader.bitsLeft() < lookupBits){
+            break;
+        }
+    }
+
+    // the last few bytes go one at a time
+    while(position < count){
+        if(!decodeOne(reader, output[position++])){
+            return false;
+        }
+    }
+    return true;
+}
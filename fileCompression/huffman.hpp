@@ -0,0 +1,69 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "bitstream.hpp"
+
+// Canonical Huffman codes over bytes, limited to 15 bits.
+// Only the length of each byte's code is stored, the codes themselves follow from the lengths:
+// shorter codes come first and codes of the same length go in byte order, each one the previous plus one.
+// That lets the decoder build its tables straight from the lengths in fixed size arrays, nothing is allocated.
+
+constexpr uint32_t maxCodeLength = 15;
+
+// a code is its bits in the low end of an integer, first bit to send is the most significant one
+struct Code{
+    uint64_t bits = 0;
+    uint32_t length = 0;
+};
+
+// code length of every byte, 0 for bytes that never occur
+using CodeLengths = std::array<uint8_t, 256>;
+
+// Huffman code lengths for the frequencies, longer codes are cut down to maxLength and the rest lengthened to make up for it
+// a lone byte still gets a 1 bit code
+CodeLengths buildCodeLengths(const std::array<uint64_t, 256>& frequencies, uint32_t maxLength = maxCodeLength);
+
+// the canonical code of every byte given its length
+std::array<Code, 256> canonicalCodes(const CodeLengths& lengths);
+
+// appends the lengths to a header: a 2 byte count of bytes used, then either a (byte, length) pair for each of them
+// or, when that would be longer, 128 bytes with the lengths of two bytes in each
+void writeCodeLengths(const CodeLengths& lengths, std::vector<uint8_t>& output);
+
+// how many bytes writeCodeLengths takes for the lengths
+size_t codeLengthsSize(const CodeLengths& lengths);
+
+// reads what writeCodeLengths wrote starting at data, moves data past it, false if it is cut short or the lengths make no code
+bool readCodeLengths(const uint8_t*& data, const uint8_t* end, CodeLengths& lengths);
+
+class HuffmanDecoder{
+    public:
+        // false if the lengths are not a valid prefix code
+        bool build(const CodeLengths& lengths);
+
+        // decodes exactly count bytes into output, false if the bits run out or hit a code that does not exist
+        bool decode(BitReader& reader, uint8_t* output, size_t count) const;
+
+    private:
+        // the decoder looks up this many bits at a time, 2^12 six byte entries still fit in the L1 cache
+        static constexpr uint32_t lookupBits = 12;
+
+        // what the next lookupBits bits decode to, up to 4 whole codes
+        // count 0 means the first code is longer than lookupBits and is decoded from the canonical ranges instead
+        struct Entry{
+            uint8_t symbols[4];
+            uint8_t count;
+            uint8_t length;
+        };
+
+        std::array<Entry, 1 << lookupBits> entries;
+        // codes of each length are firstCode[length] onwards, for counts[length] bytes starting at sorted[offsets[length]]
+        std::array<uint32_t, maxCodeLength + 1> firstCode;
+        std::array<uint32_t, maxCodeLength + 1> counts;
+        std::array<uint32_t, maxCodeLength + 1> offsets;
+        std::array<uint8_t, 256> sorted;
+
+        bool decodeOne(BitReader& reader, uint8_t& symbol) const;
+};
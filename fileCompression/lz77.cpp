@@ -0,0 +1,173 @@
+// importing necessary things
+#include "lz77.hpp"
+#include <cstring>
+#include <algorithm>
+
+
+// how hard each level searches: chain links followed per position, a match long enough to stop looking at,
+// and whether the next position is tried for a longer match before one is taken
+struct LevelParameters{
+    uint32_t chainLength;
+    uint32_t niceLength;
+    bool lazy;
+};
+
+// level 0 is Huffman codes alone and never parses
+const LevelParameters levels[maxLevel + 1] = {
+    {0, 0, false},
+    {4, 16, false},
+    {8, 32, false},
+    {32, 64, false},
+    {16, 64, true},
+    {32, 128, true},
+    {64, 256, true},
+    {256, 1024, true},
+    {1024, 4096, true},
+    {4096, 1 << 20, true},
+};
+
+// function that hashes the 4 bytes at data
+inline uint32_t hash4(const uint8_t* data, uint32_t bits){
+    uint32_t word;
+    memcpy(&word, data, 4);
+    return (word * 2654435761u) >> (32 - bits);
+}
+
+// function that counts how many bytes at a and b are the same, up to limit, 8 at a time
+inline size_t matchLength(const uint8_t* a, const uint8_t* b, size_t limit){
+    size_t length = 0;
+    while(length + 8 <= limit){
+        uint64_t x, y;
+        memcpy(&x, a + length, 8);
+        memcpy(&y, b + length, 8);
+        if(x != y){
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            return length + (__builtin_clzll(x ^ y) >> 3);
+#else
+            return length + (__builtin_ctzll(x ^ y) >> 3);
+#endif
+        }
+        length += 8;
+    }
+    while(length < limit && a[length] == b[length]){
+        length++;
+    }
+    return length;
+}
+
+ValueCode valueCode(uint32_t value){
+    if(value < 16){
+        return {(uint8_t)value, 0, 0};
+    }
+    uint32_t top = 31 - __builtin_clz(value);
+    uint32_t half = (value >> (top - 1)) & 1;
+    return {(uint8_t)(16 + (top - 4) * 2 + half), (uint8_t)(top - 1), value & ((1u << (top - 1)) - 1)};
+}
+
+const std::array<ValueBase, valueSymbols>& valueBases(){
+    static const std::array<ValueBase, valueSymbols> bases = []{
+        std::array<ValueBase, valueSymbols> table = {};
+        for(uint32_t symbol = 0; symbol < valueSymbols; symbol++){
+            if(symbol < 16){
+                table[symbol] = {symbol, 0};
+                continue;
+            }
+            uint32_t top = (symbol - 16) / 2 + 4;
+            uint32_t half = (symbol - 16) & 1;
+            table[symbol] = {(1u << top) | (half << (top - 1)), (uint8_t)(top - 1)};
+        }
+        return table;
+    }();
+    return bases;
+}
+
+void MatchFinder::parse(const uint8_t* data, size_t size, int level, std::vector<uint8_t>& literals, std::vector<Sequence>& sequences){
+    literals.clear();
+    sequences.clear();
+    const LevelParameters& parameters = levels[std::clamp(level, 1, maxLevel)];
+    head.assign((size_t)1 << hashBits, -1);
+    if(chain.size() < size){
+        chain.resize(size);
+    }
+
+    // positions before inserted are in the chains, they go in as the parse passes them
+    size_t inserted = 0;
+    auto insertUpTo = [&](size_t end){
+        for(; inserted < end; inserted++){
+            uint32_t hash = hash4(data + inserted, hashBits);
+            chain[inserted] = head[hash];
+            head[hash] = (int32_t)inserted;
+        }
+    };
+
+    // the distance of the last match, a match at it again is the cheapest one to send
+    uint32_t lastDistance = 0;
+
+    // longest match for the bytes at position, 0 if there is none of at least minMatch, position needs minMatch bytes after it
+    // a match at lastDistance is tried first, and kept unless another one is more than a byte longer
+    auto findMatch = [&](size_t position, uint32_t& distance){
+        insertUpTo(position);
+        size_t limit = size - position;
+        size_t best = minMatch - 1;
+        size_t repeated = 0;
+        if(lastDistance > 0 && lastDistance <= position){
+            repeated = matchLength(data + position - lastDistance, data + position, limit);
+            if(repeated >= minMatch){
+                best = repeated;
+                distance = lastDistance;
+            }
+        }
+        int32_t candidate = head[hash4(data + position, hashBits)];
+        for(uint32_t steps = parameters.chainLength; candidate >= 0 && steps > 0 && best < limit && best < parameters.niceLength;
+            steps--, candidate = chain[candidate]){
+            const uint8_t* earlier = data + candidate;
+            // a longer match has to get past the last byte of the best one, most candidates fail right there
+            if(earlier[best] != data[position + best]){
+                continue;
+            }
+            size_t length = matchLength(earlier, data + position, limit);
+            if(length > best && (distance != lastDistance || best < minMatch || length > best + 1)){
+                best = length;
+                distance = (uint32_t)(position - candidate);
+                if(length >= parameters.niceLength || length == limit){
+                    break;
+                }
+            }
+        }
+        insertUpTo(position + 1);
+        return best >= minMatch ? best : 0;
+    };
+
+    size_t position = 0;
+    size_t anchor = 0;
+    while(position + minMatch <= size){
+        uint32_t distance = 0;
+        size_t length = findMatch(position, distance);
+        if(length == 0){
+            position++;
+            continue;
+        }
+        // a longer match one byte on is worth one more literal
+        while(parameters.lazy && length < parameters.niceLength && position + 1 + minMatch <= size){
+            uint32_t nextDistance = 0;
+            size_t next = findMatch(position + 1, nextDistance);
+            if(next <= length){
+                break;
+            }
+            position++;
+            length = next;
+            distance = nextDistance;
+        }
+
+        literals.insert(literals.end(), data + anchor, data + position);
+        sequences.push_back({(uint32_t)(position - anchor), (uint32_t)length, distance});
+        lastDistance = distance;
+        position += length;
+        anchor = position;
+        // the greedy levels skip putting the inside of a long match in the chains, zero fill would otherwise cost a hash per byte
+        if(!parameters.lazy && length > parameters.niceLength){
+            inserted = position;
+        }
+    }
+    literals.insert(literals.end(), data + anchor, data + size);
+}
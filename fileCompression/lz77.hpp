@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// LZ77 parsing for the blocks of a file, ahead of the Huffman codes.
+// A block becomes literals, the bytes no match was found for, and sequences: a run of those literals followed by a copy
+// of earlier bytes of the same block, so every block can still be decoded on its own.
+// Matches are found with hash chains: every position is put at the head of a chain for the 4 bytes starting there, and a
+// search walks back along the chain of the position being coded. Levels trade how far it walks for speed.
+
+// shortest match worth coding, it is also what the hash covers
+constexpr uint32_t minMatch = 4;
+
+// levels go from 1, a short greedy search, to maxLevel, a long one that also looks one byte ahead for a longer match
+constexpr int maxLevel = 9;
+
+// literals before a match, the match's length, and how far back it copies from
+struct Sequence{
+    uint32_t literals;
+    uint32_t length;
+    uint32_t distance;
+};
+
+// Run lengths, match lengths and distances are sent as a byte symbol and extra bits, like deflate does:
+// values below 16 are their own symbol, bigger ones get a symbol for their top two bits and the rest go out as they are.
+constexpr uint32_t valueSymbols = 72;
+
+struct ValueCode{
+    uint8_t symbol;
+    uint8_t extraBits;
+    uint32_t extra;
+};
+
+// the symbol and extra bits of a value
+ValueCode valueCode(uint32_t value);
+
+// what a symbol's extra bits are added to and how many there are, symbols from valueSymbols on are not used
+struct ValueBase{
+    uint32_t base;
+    uint8_t extraBits;
+};
+const std::array<ValueBase, valueSymbols>& valueBases();
+
+// the hash chains, kept from block to block so they are only allocated once
+class MatchFinder{
+    public:
+        // splits size bytes at data into literals and sequences, the literals after the last match are left at the end of literals
+        void parse(const uint8_t* data, size_t size, int level, std::vector<uint8_t>& literals, std::vector<Sequence>& sequences);
+
+    private:
+        static constexpr uint32_t hashBits = 16;
+
+        // newest position of each hash, and for each position the one before it with the same hash, -1 ends a chain
+        std::vector<int32_t> head;
+        std::vector<int32_t> chain;
+};
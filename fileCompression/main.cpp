@@ -1,9 +1,53 @@
 #include "compression.hpp"
 #include <string>
+#include <vector>
 #include <iostream>
 
-int main(){
-    compressFile("testFile");
-    decompressFile("testFile.cmp");
+// usage:
+//   fileCompressor c [-0..-9] <file>          writes <file>.cmp, -0 is Huffman codes alone, higher levels search harder for repeats, -6 if not given
+//   fileCompressor d <file>.cmp               writes <file>.dcmp
+//   fileCompressor bench [-0..-9] <file>...   prints size, compress and decompress MB/s for each file at levels 0, 1, 4, 6 and 9 or the one given,
+//                                             on one thread and on every core
+// with no arguments testFile is compressed and decompressed
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        compressFile("testFile");
+        decompressFile("testFile.cmp");
+        return 0;
+    }
+
+    std::string mode = argv[1];
+    std::vector<std::string> files;
+    std::vector<int> levels;
+    for(int i = 2; i < argc; i++){
+        std::string argument = argv[i];
+        if(argument.size() == 2 && argument[0] == '-' && argument[1] >= '0' && argument[1] <= '9'){
+            levels.push_back(argument[1] - '0');
+        }
+        else{
+            files.push_back(argument);
+        }
+    }
+    if(files.empty() || (mode != "c" && mode != "d" && mode != "bench")){
+        std::cout << "usage: " << argv[0] << " c|d|bench [-0..-9] <file>..." << std::endl;
+        return 1;
+    }
+
+    if(mode == "bench"){
+        if(levels.empty()){
+            benchmarking(files);
+        }
+        else{
+            benchmarking(files, levels);
+        }
+        return 0;
+    }
+    int level = levels.empty() ? defaultLevel : levels.back();
+    for(const std::string& file: files){
+        std::string written = mode == "c" ? compressFile(file, 0, level) : decompressFile(file);
+        if(written.empty()){
+            return 1;
+        }
+    }
     return 0;
-}
\ No newline at end of file
+}
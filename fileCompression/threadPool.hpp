@@ -0,0 +1,72 @@
+#pragma once
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <future>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+// Fixed set of worker threads taking tasks in the order they were submitted.
+// submit hands back a future, so the caller collects results in whatever order it needs, blocks go back in file order.
+// The destructor lets the tasks already submitted finish before the workers are joined.
+
+class ThreadPool{
+    public:
+        explicit ThreadPool(unsigned threads){
+            for(unsigned i = 0; i < threads; i++){
+                workers.emplace_back([this]{ work(); });
+            }
+        }
+
+        ~ThreadPool(){
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stopping = true;
+            }
+            cv.notify_all();
+            for(std::thread& worker: workers){
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // queues the task, its result or exception comes out of the future
+        template<class Task>
+        auto submit(Task task) -> std::future<decltype(task())>{
+            auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+            auto result = packaged->get_future();
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                tasks.push([packaged]{ (*packaged)(); });
+            }
+            cv.notify_one();
+            return result;
+        }
+
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool stopping = false;
+
+        void work(){
+            while(true){
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv.wait(lock, [this]{ return stopping || !tasks.empty(); });
+                    if(tasks.empty()){
+                        return;
+                    }
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                task();
+            }
+        }
+};
@@ -0,0 +1,154 @@
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/uio.h>
+#include "batchSocket.hpp"
+
+//by Robert Britton
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+constexpr size_t maxSegments = 64;//kernel limit on segments in one UDP_SEGMENT send
+constexpr size_t maxSegmentedBytes = 65000;
+
+boost::asio::ip::udp::endpoint toEndPoint(const sockaddr_storage& address, socklen_t length){
+    boost::asio::ip::udp::endpoint endPoint;
+    length = std::min<socklen_t>(length, endPoint.capacity());
+    memcpy(endPoint.data(), &address, length);
+    endPoint.resize(length);
+    return endPoint;
+}
+
+BatchSocket::BatchSocket(boost::asio::ip::udp::socket& socket, size_t ringSize, size_t bufferSize, bool segmentation):
+fd(socket.native_handle()), ringSize(ringSize), bufferSize(bufferSize),
+ring(ringSize * bufferSize), addresses(ringSize), controls(ringSize * CMSG_SPACE(sizeof(int))) {
+#ifdef __linux__
+    if(segmentation){//needs 4.18 for UDP_SEGMENT and 5.0 for UDP_GRO, older kernels just keep plain batches
+        int on = 1;
+        this->segmentation = setsockopt(fd, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+        if(!this->segmentation)std::cerr << "UDP_GRO not supported, sending and receiving without segmentation" << std::endl;
+    }
+    headers.resize(ringSize);
+    vectors.resize(ringSize);
+    for(size_t i = 0; i < ringSize; i++){
+        vectors[i] = {ring.data() + i * bufferSize, bufferSize};
+        headers[i].msg_hdr = {};
+        headers[i].msg_hdr.msg_iov = &vectors[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+    }
+#else
+    if(segmentation)std::cerr << "UDP segmentation is only available on Linux" << std::endl;
+#endif
+}
+
+void BatchSocket::split(char* data, size_t length, size_t segment, const sockaddr_storage& address, socklen_t addressLength){//one GRO buffer holds several datagrams of segment bytes each
+    boost::asio::ip::udp::endpoint from = toEndPoint(address, addressLength);
+    if(segment == 0)segment = length;
+    for(size_t offset = 0; offset < length; offset += segment){
+        received.push_back({std::string_view(data + offset, std::min(segment, length - offset)), from});
+    }
+}
+
+size_t BatchSocket::receive(int milliseconds){
+    received.clear();
+    pollfd descriptor = {fd, POLLIN, 0};
+    if(poll(&descriptor, 1, milliseconds) <= 0)return 0;
+#ifdef __linux__
+    for(size_t i = 0; i < ringSize; i++){//the kernel overwrites the lengths, so they are reset every time
+        headers[i].msg_hdr.msg_name = &addresses[i];
+        headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        headers[i].msg_hdr.msg_control = controls.data() + i * CMSG_SPACE(sizeof(int));
+        headers[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(int));
+    }
+    int count = recvmmsg(fd, headers.data(), ringSize, MSG_DONTWAIT, nullptr);
+    for(int i = 0; i < count; i++){
+        if(headers[i].msg_hdr.msg_flags & MSG_TRUNC){//the tail is gone, so parsing what is left would accept a partial message
+            std::cerr << "dropping a datagram larger than the " << bufferSize << " byte receive buffer from " << toEndPoint(addresses[i], headers[i].msg_hdr.msg_namelen) << std::endl;
+            continue;
+        }
+        size_t segment = 0;
+        for(cmsghdr* control = CMSG_FIRSTHDR(&headers[i].msg_hdr); control != nullptr; control = CMSG_NXTHDR(&headers[i].msg_hdr, control)){
+            if(control->cmsg_level == IPPROTO_UDP && control->cmsg_type == UDP_GRO){
+                int size;
+                memcpy(&size, CMSG_DATA(control), sizeof(size));
+                segment = size;
+            }
+        }
+        split(ring.data() + i * bufferSize, headers[i].msg_len, segment, addresses[i], headers[i].msg_hdr.msg_namelen);
+    }
+#else
+    for(size_t i = 0; i < ringSize; i++){
+        socklen_t addressLength = sizeof(sockaddr_storage);
+        ssize_t n = recvfrom(fd, ring.data() + i * bufferSize, bufferSize, MSG_DONTWAIT, (sockaddr*)&addresses[i], &addressLength);
+        if(n < 0)break;
+        split(ring.data() + i * bufferSize, n, 0, addresses[i], addressLength);
+    }
+#endif
+    return received.size();
+}
+
+void BatchSocket::queue(std::string message, const boost::asio::ip::udp::endpoint& destination){
+    outgoing.push_back({std::move(message), destination});
+}
+
+size_t BatchSocket::flush(){
+    size_t calls = 0;
+#ifdef __linux__
+    sendHeaders.clear();
+    sendVectors.clear();
+    sendVectors.reserve(outgoing.size());//pointers into it are taken below, so it must not grow
+    sendControls.assign(outgoing.size() * CMSG_SPACE(sizeof(uint16_t)), 0);
+    for(size_t i = 0; i < outgoing.size();){
+        size_t first = i;
+        size_t size = outgoing[i].first.size();
+        size_t total = 0;
+        do{//equal sized datagrams to one destination share a send, only the last may be shorter
+            sendVectors.push_back({outgoing[i].first.data(), outgoing[i].first.size()});
+            total += outgoing[i].first.size();
+            i++;
+        }while(segmentation && i < outgoing.size() && i - first < maxSegments && outgoing[i].second == outgoing[first].second &&
+               outgoing[i - 1].first.size() == size && outgoing[i].first.size() <= size && total + outgoing[i].first.size() <= maxSegmentedBytes);
+        mmsghdr header = {};
+        header.msg_hdr.msg_name = outgoing[first].second.data();
+        header.msg_hdr.msg_namelen = outgoing[first].second.size();
+        header.msg_hdr.msg_iov = &sendVectors[first];
+        header.msg_hdr.msg_iovlen = i - first;
+        if(i - first > 1){
+            char* control = sendControls.data() + sendHeaders.size() * CMSG_SPACE(sizeof(uint16_t));
+            header.msg_hdr.msg_control = control;
+            header.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            cmsghdr* segment = CMSG_FIRSTHDR(&header.msg_hdr);
+            segment->cmsg_level = IPPROTO_UDP;
+            segment->cmsg_type = UDP_SEGMENT;
+            segment->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segmentSize = size;
+            memcpy(CMSG_DATA(segment), &segmentSize, sizeof(segmentSize));
+        }
+        sendHeaders.push_back(header);
+    }
+    for(size_t sent = 0; sent < sendHeaders.size();){
+        int n = sendmmsg(fd, sendHeaders.data() + sent, sendHeaders.size() - sent, 0);
+        calls++;
+        if(n <= 0){
+            std::cerr << "sendmmsg failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        sent += n;
+    }
+#else
+    for(auto& [message, destination] : outgoing){
+        sendto(fd, message.data(), message.size(), 0, destination.data(), destination.size());
+        calls++;
+    }
+#endif
+    outgoing.clear();
+    return calls;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <string_view>
+#include <sys/socket.h>
+#include <boost/asio.hpp>
+
+// Batched datagram I/O on an already bound UDP socket.
+// On Linux one recvmmsg drains up to ringSize datagrams into a preallocated ring and one sendmmsg sends everything queued.
+// With segmentation, runs of equal sized datagrams to one destination go out as a single UDP_SEGMENT send and
+// UDP_GRO super-datagrams are split again on receive. Elsewhere it falls back to one recvfrom/sendto per datagram.
+
+class BatchSocket{
+    private:
+        int fd;
+        size_t ringSize;
+        size_t bufferSize;
+        bool segmentation = false;
+        std::vector<char> ring;//ringSize buffers of bufferSize bytes, reused by every receive
+        std::vector<sockaddr_storage> addresses;
+        std::vector<char> controls;//ancillary data per buffer, carries the GRO segment size
+        std::vector<std::pair<std::string_view, boost::asio::ip::udp::endpoint>> received;//views into ring, valid until the next receive
+        std::vector<std::pair<std::string, boost::asio::ip::udp::endpoint>> outgoing;
+#ifdef __linux__
+        std::vector<mmsghdr> headers;//receive headers point into ring, addresses and controls once and are reused
+        std::vector<iovec> vectors;
+        std::vector<mmsghdr> sendHeaders;//kept between flushes so sending does not allocate once warmed up
+        std::vector<iovec> sendVectors;
+        std::vector<char> sendControls;
+#endif
+
+        void split(char* data, size_t length, size_t segment, const sockaddr_storage& address, socklen_t addressLength);
+
+    public:
+        BatchSocket(boost::asio::ip::udp::socket& socket, size_t ringSize, size_t bufferSize, bool segmentation = false);
+
+        size_t receive(int milliseconds = -1);//waits up to milliseconds (forever if negative) for one datagram, then takes whatever else is already waiting
+        std::string_view data(size_t i) const { return received[i].first; }
+        const boost::asio::ip::udp::endpoint& sender(size_t i) const { return received[i].second; }
+
+        void queue(std::string message, const boost::asio::ip::udp::endpoint& destination);
+        size_t flush();//sends everything queued, returns the number of system calls it took
+        bool segmenting() const { return segmentation; }
+};
@@ -0,0 +1,492 @@
+#include <iostream>
+#include <cstring>
+#include <atomic>
+#include <unordered_map>
+#include <memory>
+#include <chrono>
+#include <unistd.h>
+#include "eventLoop.hpp"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#endif
+
+//by Robert Britton
+
+void EventLoop::watch(boost::asio::ip::udp::socket& socket, Handler handler){
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        newWatches.push_back({socket.native_handle(), std::move(handler)});
+    }
+    wake();
+}
+
+void EventLoop::send(boost::asio::ip::udp::socket& socket, std::string message, const boost::asio::ip::udp::endpoint& destination){
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        first = newSends.empty();
+        newSends.push_back({socket.native_handle(), std::move(message), destination});
+    }
+    if(first && std::this_thread::get_id() != loopThread)wake();//the loop takes every queued send at once, so one wakeup is enough
+}
+
+void EventLoop::wake(){
+    uint64_t one = 1;
+    if(wakeFd >= 0 && write(wakeFd, &one, sizeof(one)) < 0)std::cerr << "Event loop wakeup failed" << std::endl;
+}
+
+#ifdef __linux__
+
+constexpr size_t maxDatagram = 65536;
+constexpr size_t bufferCount = 256;//receive buffers registered with the kernel, shared by every socket, a power of two
+constexpr size_t bufferSize = maxDatagram + 512;//payload plus the io_uring_recvmsg_out header and sender address
+constexpr unsigned ringEntries = 1024;
+constexpr uint16_t bufferGroup = 0;
+
+enum : uint64_t { receiveTag = 1ULL << 56, sendTag = 2ULL << 56, wakeTag = 3ULL << 56, probeTag = 4ULL << 56, tagMask = 0xFFULL << 56 };
+
+boost::asio::ip::udp::endpoint toEndPoint(const void* address, size_t length){
+    boost::asio::ip::udp::endpoint endPoint;
+    length = std::min<size_t>(length, endPoint.capacity());
+    memcpy(endPoint.data(), address, length);
+    endPoint.resize(length);
+    return endPoint;
+}
+
+class EpollLoop : public EventLoop{
+    private:
+        int epollFd;
+        std::unordered_map<int, Handler> handlers;
+        std::vector<char> ring;//one set of receive buffers is enough, only the loop thread receives
+        std::vector<mmsghdr> headers;
+        std::vector<iovec> vectors;
+        std::vector<sockaddr_storage> addresses;
+        static constexpr size_t ringSize = 32;
+
+        void drain(int fd, std::vector<Datagram>& datagrams){
+            while(true){
+                for(size_t i = 0; i < ringSize; i++){
+                    headers[i].msg_hdr.msg_name = &addresses[i];
+                    headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+                }
+                int n = recvmmsg(fd, headers.data(), ringSize, MSG_DONTWAIT, nullptr);
+                for(int i = 0; i < n; i++){
+                    datagrams.push_back({std::string(ring.data() + i * maxDatagram, headers[i].msg_len),
+                                         toEndPoint(&addresses[i], headers[i].msg_hdr.msg_namelen)});
+                }
+                if(n < (int)ringSize)return;//the socket is empty
+            }
+        }
+
+        void sendAll(std::vector<std::tuple<int, std::string, boost::asio::ip::udp::endpoint>>& sends){
+            std::vector<mmsghdr> sendHeaders(sends.size());
+            std::vector<iovec> sendVectors(sends.size());
+            for(size_t i = 0; i < sends.size(); i++){
+                auto& [fd, message, destination] = sends[i];
+                sendVectors[i] = {message.data(), message.size()};
+                sendHeaders[i] = {};
+                sendHeaders[i].msg_hdr.msg_name = destination.data();
+                sendHeaders[i].msg_hdr.msg_namelen = destination.size();
+                sendHeaders[i].msg_hdr.msg_iov = &sendVectors[i];
+                sendHeaders[i].msg_hdr.msg_iovlen = 1;
+            }
+            for(size_t first = 0; first < sends.size();){//one sendmmsg per run of sends on the same socket
+                size_t last = first;
+                while(last < sends.size() && std::get<0>(sends[last]) == std::get<0>(sends[first]))last++;
+                int n = sendmmsg(std::get<0>(sends[first]), sendHeaders.data() + first, last - first, 0);
+                first += n > 0 ? n : 1;//a failed datagram is dropped like a failed send_to would be
+            }
+        }
+
+    public:
+        EpollLoop(): ring(ringSize * maxDatagram), headers(ringSize), vectors(ringSize), addresses(ringSize) {
+            epollFd = epoll_create1(0);
+            wakeFd = eventfd(0, EFD_NONBLOCK);
+            epoll_event event = {EPOLLIN, {.fd = wakeFd}};
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+            for(size_t i = 0; i < ringSize; i++){
+                vectors[i] = {ring.data() + i * maxDatagram, maxDatagram};
+                headers[i] = {};
+                headers[i].msg_hdr.msg_iov = &vectors[i];
+                headers[i].msg_hdr.msg_iovlen = 1;
+            }
+        }
+
+        std::string name() const override { return "epoll"; }
+
+        void run() override{
+            loopThread = std::this_thread::get_id();
+            std::vector<epoll_event> events(64);
+            std::vector<std::pair<int, Handler>> watches;
+            std::vector<std::tuple<int, std::string, boost::asio::ip::udp::endpoint>> sends;
+            std::vector<Datagram> datagrams;
+            while(true){
+                int n = epoll_wait(epollFd, events.data(), events.size(), -1);
+                for(int i = 0; i < n; i++){
+                    int fd = events[i].data.fd;
+                    if(fd == wakeFd){
+                        uint64_t count;
+                        while(read(wakeFd, &count, sizeof(count)) > 0);
+                        continue;
+                    }
+                    datagrams.clear();
+                    drain(fd, datagrams);
+                    if(!datagrams.empty())handlers[fd](datagrams);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    watches.swap(newWatches);
+                    sends.swap(newSends);
+                }
+                for(auto& [fd, handler] : watches){
+                    handlers[fd] = std::move(handler);
+                    epoll_event event = {EPOLLIN, {.fd = fd}};
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+                }
+                watches.clear();
+                sendAll(sends);
+                sends.clear();
+            }
+        }
+};
+
+class UringLoop : public EventLoop{
+    private:
+        int ringFd = -1;
+        unsigned* sqHead;
+        unsigned* sqTail;
+        unsigned* sqMask;
+        unsigned* sqArray;
+        unsigned* cqHead;
+        unsigned* cqTail;
+        unsigned* cqMask;
+        io_uring_sqe* sqes = nullptr;
+        io_uring_cqe* cqes;
+        unsigned toSubmit = 0;
+        char* rings = nullptr;
+        size_t ringsSize = 0;
+        size_t sqesSize = 0;
+
+        io_uring_buf_ring* bufferRing = nullptr;//registered with the kernel, multishot receives pick their buffer from it
+        char* buffers = nullptr;
+        uint16_t bufferTail = 0;
+        bool multishot = true;//false where the buffer ring registers but never hands out buffers, each socket then rearms a one shot recvmsg
+
+        struct Watch{
+            int fd;
+            Handler handler;
+            msghdr header;//multishot: how much room to leave for the sender address in each buffer, one shot: where to receive
+            std::vector<Datagram> ready;
+            std::unique_ptr<char[]> buffer;//one shot only, left uninitialized so untouched pages cost nothing
+            iovec vector;
+            sockaddr_storage address;
+        };
+        std::vector<std::unique_ptr<Watch>> watching;
+
+        struct Send{
+            std::string message;
+            boost::asio::ip::udp::endpoint destination;
+            iovec vector;
+            msghdr header;
+        };
+        std::unordered_map<uint64_t, std::unique_ptr<Send>> sending;//kept alive until the kernel reports the send complete
+        uint64_t sendCounter = 0;
+        uint64_t wakeCount = 0;
+
+        static int enter(int fd, unsigned submit, unsigned wait, unsigned flags){
+            return syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0);
+        }
+
+        io_uring_sqe* nextSqe(){
+            unsigned tail = *sqTail;
+            if(tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) > *sqMask){//full, hand what is queued to the kernel first
+                enter(ringFd, toSubmit, 0, 0);
+                toSubmit = 0;
+            }
+            unsigned index = tail & *sqMask;
+            io_uring_sqe* sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqArray[index] = index;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+            toSubmit++;
+            return sqe;
+        }
+
+        void recycle(uint16_t bid){//gives a receive buffer back to the kernel
+            if(bid >= bufferCount)return;
+            io_uring_buf* buffer = &bufferRing->bufs[bufferTail & (bufferCount - 1)];
+            buffer->addr = (uint64_t)(buffers + bid * bufferSize);
+            buffer->len = bufferSize;
+            buffer->bid = bid;
+            bufferTail++;
+            __atomic_store_n(&bufferRing->tail, bufferTail, __ATOMIC_RELEASE);
+        }
+
+        void armReceive(size_t index){//one multishot recvmsg keeps producing completions until it runs out of buffers
+            Watch& watch = *watching[index];
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_RECVMSG;
+            sqe->fd = watch.fd;
+            sqe->addr = (uint64_t)&watch.header;
+            sqe->len = 1;
+            sqe->user_data = receiveTag | index;
+            if(multishot){
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = bufferGroup;
+            }
+            else watch.header.msg_namelen = sizeof(sockaddr_storage);
+        }
+
+        bool probeMultishot(){//sends a datagram to itself, some kernels and sandboxes accept the buffer ring but answer every receive with -ENOBUFS
+            int probe = socket(AF_INET, SOCK_DGRAM, 0);
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            if(probe < 0 || bind(probe, (sockaddr*)&address, sizeof(address)) != 0 || getsockname(probe, (sockaddr*)&address, &length) != 0 ||
+               sendto(probe, "probe", 5, 0, (sockaddr*)&address, sizeof(address)) != 5){
+                if(probe >= 0)close(probe);
+                return false;
+            }
+            msghdr header = {};
+            header.msg_namelen = sizeof(sockaddr_storage);
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_RECVMSG;
+            sqe->fd = probe;
+            sqe->addr = (uint64_t)&header;
+            sqe->len = 1;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = bufferGroup;
+            sqe->user_data = probeTag;
+            enter(ringFd, toSubmit, 0, 0);
+            toSubmit = 0;
+            bool works = false;
+            bool answered = false;
+            for(int waited = 0; waited < 100 && !answered; waited++){//the datagram is already queued, so the answer comes almost at once
+                enter(ringFd, 0, 0, IORING_ENTER_GETEVENTS);
+                unsigned head = *cqHead;
+                for(; head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE); head++){
+                    const io_uring_cqe& cqe = cqes[head & *cqMask];
+                    if(cqe.user_data != probeTag)continue;
+                    answered = true;
+                    works = cqe.res > 0;
+                    if(works && (cqe.flags & IORING_CQE_F_BUFFER))recycle(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                    if(cqe.flags & IORING_CQE_F_MORE){//still armed, cancel it before the socket goes away
+                        io_uring_sqe* cancel = nextSqe();
+                        cancel->opcode = IORING_OP_ASYNC_CANCEL;
+                        cancel->addr = probeTag;
+                        cancel->user_data = probeTag;
+                        enter(ringFd, toSubmit, 0, 0);
+                        toSubmit = 0;
+                    }
+                }
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+                if(!answered)std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            close(probe);
+            return works;
+        }
+
+        void armWake(){
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = wakeFd;
+            sqe->addr = (uint64_t)&wakeCount;
+            sqe->len = sizeof(wakeCount);
+            sqe->user_data = wakeTag;
+        }
+
+        void queueSend(int fd, std::string message, const boost::asio::ip::udp::endpoint& destination){
+            auto send = std::make_unique<Send>();
+            send->message = std::move(message);
+            send->destination = destination;
+            send->vector = {send->message.data(), send->message.size()};
+            send->header = {};
+            send->header.msg_name = send->destination.data();
+            send->header.msg_namelen = send->destination.size();
+            send->header.msg_iov = &send->vector;
+            send->header.msg_iovlen = 1;
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = fd;
+            sqe->addr = (uint64_t)&send->header;
+            sqe->len = 1;
+            sqe->user_data = sendTag | sendCounter;
+            sending[sendCounter++] = std::move(send);
+        }
+
+        void completion(const io_uring_cqe& cqe, std::vector<size_t>& readyWatches){
+            uint64_t tag = cqe.user_data & tagMask;
+            uint64_t index = cqe.user_data & ~tagMask;
+            if(tag == sendTag){
+                sending.erase(index);
+                return;
+            }
+            if(tag == wakeTag){
+                armWake();
+                return;
+            }
+            if(tag == probeTag){
+                if(cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER))recycle(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                return;
+            }
+            Watch& watch = *watching[index];
+            if(!multishot){
+                if(cqe.res >= 0){
+                    if(watch.ready.empty())readyWatches.push_back(index);
+                    socklen_t length = watch.address.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+                    watch.ready.push_back({std::string(watch.buffer.get(), cqe.res), toEndPoint(&watch.address, length)});
+                }
+                armReceive(index);
+                return;
+            }
+            if(cqe.flags & IORING_CQE_F_BUFFER){
+                uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                char* buffer = buffers + bid * bufferSize;
+                if(cqe.res >= (int)sizeof(io_uring_recvmsg_out)){//header, then the room left for the address, then the payload
+                    io_uring_recvmsg_out* out = (io_uring_recvmsg_out*)buffer;
+                    char* name = buffer + sizeof(io_uring_recvmsg_out);
+                    char* payload = name + watch.header.msg_namelen + watch.header.msg_controllen;
+                    if(watch.ready.empty())readyWatches.push_back(index);
+                    watch.ready.push_back({std::string(payload, out->payloadlen), toEndPoint(name, out->namelen)});
+                }
+                recycle(bid);
+            }
+            if(!(cqe.flags & IORING_CQE_F_MORE))armReceive(index);//stopped, usually -ENOBUFS while every buffer was in use
+        }
+
+        static void* mapOrNull(size_t size, int flags, int fd, off_t offset){
+            void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, offset);
+            return mapping == MAP_FAILED ? nullptr : mapping;
+        }
+
+        bool release(){//undoes a setup that failed part way, always false so setup can return it
+            if(buffers != nullptr)munmap(buffers, bufferCount * bufferSize);
+            if(bufferRing != nullptr)munmap(bufferRing, bufferCount * sizeof(io_uring_buf) + 4096);
+            if(sqes != nullptr)munmap(sqes, sqesSize);
+            if(rings != nullptr)munmap(rings, ringsSize);
+            buffers = nullptr;
+            bufferRing = nullptr;
+            sqes = nullptr;
+            rings = nullptr;
+            close(ringFd);
+            ringFd = -1;
+            return false;
+        }
+
+    public:
+        bool setup(){
+            io_uring_params params = {};
+            ringFd = syscall(__NR_io_uring_setup, ringEntries, &params);
+            if(ringFd < 0)return false;
+            if(!(params.features & IORING_FEAT_SINGLE_MMAP))return release();
+            size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            ringsSize = std::max(sqSize, cqSize);
+            sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            rings = (char*)mapOrNull(ringsSize, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+            sqes = (io_uring_sqe*)mapOrNull(sqesSize, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+            if(rings == nullptr || sqes == nullptr)return release();
+            sqHead = (unsigned*)(rings + params.sq_off.head);
+            sqTail = (unsigned*)(rings + params.sq_off.tail);
+            sqMask = (unsigned*)(rings + params.sq_off.ring_mask);
+            sqArray = (unsigned*)(rings + params.sq_off.array);
+            cqHead = (unsigned*)(rings + params.cq_off.head);
+            cqTail = (unsigned*)(rings + params.cq_off.tail);
+            cqMask = (unsigned*)(rings + params.cq_off.ring_mask);
+            cqes = (io_uring_cqe*)(rings + params.cq_off.cqes);
+
+            //one spare page after the ring, some kernels read past it and must find zeros there rather than the next mapping
+            bufferRing = (io_uring_buf_ring*)mapOrNull(bufferCount * sizeof(io_uring_buf) + 4096, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            buffers = (char*)mapOrNull(bufferCount * bufferSize, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(bufferRing == nullptr || buffers == nullptr)return release();
+            io_uring_buf_reg registration = {};
+            registration.ring_addr = (uint64_t)bufferRing;
+            registration.ring_entries = bufferCount;
+            registration.bgid = bufferGroup;
+            if(syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)return release();//needs 5.19, multishot recvmsg needs 6.0
+            for(uint16_t bid = 0; bid < bufferCount; bid++)recycle(bid);
+            multishot = probeMultishot();
+            wakeFd = eventfd(0, 0);
+            armWake();
+            return true;
+        }
+
+        std::string name() const override { return multishot ? "io_uring" : "io_uring(one shot)"; }
+
+        void run() override{
+            std::vector<std::pair<int, Handler>> watches;
+            std::vector<std::tuple<int, std::string, boost::asio::ip::udp::endpoint>> sends;
+            std::vector<size_t> readyWatches;
+            loopThread = std::this_thread::get_id();
+            while(true){
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    watches.swap(newWatches);
+                    sends.swap(newSends);
+                }
+                for(auto& [fd, handler] : watches){
+                    auto watch = std::make_unique<Watch>();
+                    watch->fd = fd;
+                    watch->handler = std::move(handler);
+                    watch->header = {};
+                    watch->header.msg_namelen = sizeof(sockaddr_storage);
+                    if(!multishot){
+                        watch->buffer.reset(new char[maxDatagram]);
+                        watch->vector = {watch->buffer.get(), maxDatagram};
+                        watch->header.msg_name = &watch->address;
+                        watch->header.msg_iov = &watch->vector;
+                        watch->header.msg_iovlen = 1;
+                    }
+                    watching.push_back(std::move(watch));
+                    armReceive(watching.size() - 1);
+                }
+                watches.clear();
+                for(auto& [fd, message, destination] : sends)queueSend(fd, std::move(message), destination);
+                sends.clear();
+
+                if(enter(ringFd, toSubmit, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR){//submits everything queued and waits in one call
+                    std::cerr << "io_uring_enter failed: " << strerror(errno) << std::endl;
+                    exit(1);
+                }
+                toSubmit = 0;
+                unsigned head = *cqHead;
+                unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+                for(; head != tail; head++)completion(cqes[head & *cqMask], readyWatches);
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+                for(size_t index : readyWatches){//each socket's handler sees everything it got this round at once
+                    watching[index]->handler(watching[index]->ready);
+                    watching[index]->ready.clear();
+                }
+                readyWatches.clear();
+            }
+        }
+};
+
+EventLoop* EventLoop::create(const std::string& backend){
+    if(backend == "uring"){
+        UringLoop* loop = new UringLoop();
+        if(loop->setup())return loop;
+        delete loop;
+        std::cerr << "io_uring is not available, using epoll" << std::endl;
+    }
+    return new EpollLoop();
+}
+
+#else
+
+EventLoop* EventLoop::create(const std::string& backend){
+    std::cerr << "Event loops need Linux, keeping one blocking thread per socket" << std::endl;
+    return nullptr;
+}
+
+#endif
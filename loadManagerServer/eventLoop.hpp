@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <tuple>
+#include <thread>
+#include <functional>
+#include <boost/asio.hpp>
+
+// One thread that receives on every watched socket instead of a blocking thread per socket.
+// The io_uring backend keeps a multishot recvmsg armed on each socket, taking buffers from a ring registered with the kernel,
+// and queues sends so everything produced by one loop iteration is submitted with a single io_uring_enter.
+// The epoll backend is used where io_uring can not be set up (older kernels, seccomp filters) and drains ready sockets with recvmmsg.
+// Neither exists outside Linux, create returns nullptr there and the manager keeps its blocking threads.
+
+struct Datagram{
+    std::string data;
+    boost::asio::ip::udp::endpoint sender;
+};
+
+class EventLoop{
+    public:
+        typedef std::function<void(std::vector<Datagram>&)> Handler;//runs on the loop thread with everything one socket had ready, must not block
+
+        virtual ~EventLoop() = default;
+        void watch(boost::asio::ip::udp::socket& socket, Handler handler);//safe from any thread, also once run has started
+        void send(boost::asio::ip::udp::socket& socket, std::string message, const boost::asio::ip::udp::endpoint& destination);//safe from any thread
+        virtual void run() = 0;
+        virtual std::string name() const = 0;
+
+        static EventLoop* create(const std::string& backend);//"uring" or "epoll", uring falls back to epoll if it can not be set up
+
+    protected:
+        int wakeFd = -1;//eventfd written whenever work is queued for the loop thread
+        std::thread::id loopThread;//handlers sending replies do not need to wake the loop they run on
+        std::mutex mtx;
+        std::vector<std::pair<int, Handler>> newWatches;
+        std::vector<std::tuple<int, std::string, boost::asio::ip::udp::endpoint>> newSends;
+
+        void wake();
+};
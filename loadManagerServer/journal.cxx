@@ -0,0 +1,181 @@
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <array>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "journal.hpp"
+
+//by Robert Britton
+
+constexpr size_t headerSize = 8;//4 byte length then 4 byte crc32 of the payload
+constexpr size_t minimumCapacity = 1 << 24;
+
+uint32_t crc32(const char* data, size_t length){
+    static const std::array<uint32_t, 256> table = []{
+        std::array<uint32_t, 256> entries;
+        for(uint32_t i = 0; i < 256; i++){
+            uint32_t c = i;
+            for(int k = 0; k < 8; k++)c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    uint32_t crc = 0xFFFFFFFF;
+    for(size_t i = 0; i < length; i++)crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
+int syncFile(int fd){
+#ifdef __APPLE__
+    return fsync(fd);
+#else
+    return fdatasync(fd);//stores through the mapping are already in the page cache, this writes them back
+#endif
+}
+
+void Journal::map(size_t size){
+    if(base != nullptr)munmap(base, capacity);
+    if(ftruncate(fd, size) != 0)std::cerr << "Journal could not grow to " << size << " bytes" << std::endl;
+    base = static_cast<char*>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    if(base == MAP_FAILED){
+        std::cerr << "Journal " << path << " could not be mapped" << std::endl;
+        exit(1);
+    }
+    capacity = size;
+}
+
+void Journal::reserve(size_t bytes){//called with mtx held, the committer only touches fd so remapping is safe
+    if(end + bytes <= capacity)return;
+    size_t size = capacity * 2;
+    while(size < end + bytes)size *= 2;
+    map(size);
+}
+
+bool Journal::read(size_t& offset, std::string& record){
+    if(offset + headerSize > capacity)return false;
+    uint32_t length, crc;
+    memcpy(&length, base + offset, 4);
+    memcpy(&crc, base + offset + 4, 4);
+    if(length == 0 || offset + headerSize + length > capacity)return false;
+    if(crc32(base + offset + headerSize, length) != crc)return false;
+    record.assign(base + offset + headerSize, length);
+    offset += headerSize + length;
+    return true;
+}
+
+bool Journal::open(const std::string& fileName, std::vector<std::string>& records){
+    path = fileName;
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd < 0){
+        std::cerr << "Journal " << path << " could not be opened" << std::endl;
+        return false;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    map(std::max<size_t>(info.st_size, minimumCapacity));
+
+    std::string record;
+    while(read(end, record))records.push_back(record);
+    if(end + headerSize <= capacity){//clears a torn tail so a shorter record written over it can not run into stale bytes
+        uint32_t length;
+        memcpy(&length, base + end, 4);
+        memset(base + end, 0, std::min<size_t>(capacity - end, headerSize + (size_t)length));
+    }
+
+    committer = std::thread(&Journal::commitLoop, this);
+    return true;
+}
+
+uint64_t Journal::append(const std::string& record){
+    std::lock_guard<std::mutex> lock(mtx);
+    reserve(headerSize + record.size());
+    uint32_t length = record.size();
+    uint32_t crc = crc32(record.data(), record.size());
+    memcpy(base + end + headerSize, record.data(), record.size());
+    memcpy(base + end + 4, &crc, 4);
+    memcpy(base + end, &length, 4);
+    end += headerSize + record.size();
+    commitCv.notify_one();
+    return ++appended;
+}
+
+void Journal::commitLoop(){//group commit, everything appended while a sync is running goes out with the next one
+    std::unique_lock<std::mutex> lock(mtx);
+    while(true){
+        commitCv.wait(lock, [this]{ return appended > durable || stopping; });
+        if(stopping && appended == durable)return;
+        uint64_t target = appended;
+        syncing = true;
+        lock.unlock();
+        syncFile(fd);
+        lock.lock();
+        syncing = false;
+        durable = target;
+        durableCv.notify_all();
+    }
+}
+
+void Journal::waitDurable(uint64_t sequence){
+    std::unique_lock<std::mutex> lock(mtx);
+    durableCv.wait(lock, [this, sequence]{ return durable >= sequence; });
+}
+
+size_t Journal::size(){
+    std::lock_guard<std::mutex> lock(mtx);
+    return end;
+}
+
+void Journal::compact(const std::function<std::vector<std::string>(const std::vector<std::string>&)>& reduce){
+    std::unique_lock<std::mutex> lock(mtx);
+    durableCv.wait(lock, [this]{ return !syncing; });//the committer must not be using fd while it is swapped
+
+    std::vector<std::string> records;
+    std::string record;
+    for(size_t offset = 0; offset < end && read(offset, record);)records.push_back(record);
+    std::vector<std::string> snapshot = reduce(records);
+
+    std::string temporary = path + ".compact";
+    int snapshotFd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(snapshotFd < 0){
+        std::cerr << "Journal snapshot " << temporary << " could not be created" << std::endl;
+        return;
+    }
+    std::string data;
+    for(const std::string& kept : snapshot){
+        uint32_t length = kept.size();
+        uint32_t crc = crc32(kept.data(), kept.size());
+        data.append(reinterpret_cast<const char*>(&length), 4);
+        data.append(reinterpret_cast<const char*>(&crc), 4);
+        data += kept;
+    }
+    if(write(snapshotFd, data.data(), data.size()) != (ssize_t)data.size() || syncFile(snapshotFd) != 0 ||
+       rename(temporary.c_str(), path.c_str()) != 0){
+        std::cerr << "Journal snapshot " << temporary << " could not be written" << std::endl;
+        ::close(snapshotFd);
+        return;
+    }
+
+    munmap(base, capacity);
+    base = nullptr;
+    ::close(fd);
+    fd = snapshotFd;
+    end = data.size();
+    map(std::max(minimumCapacity, end * 2));
+    durable = appended;//everything appended so far is in the synced snapshot
+    durableCv.notify_all();
+}
+
+Journal::~Journal(){
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+        commitCv.notify_one();
+    }
+    if(committer.joinable())committer.join();
+    if(base != nullptr)munmap(base, capacity);
+    if(fd >= 0)::close(fd);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+// Append only write ahead log kept in a memory mapped file.
+// Each record is [length][crc32][payload]; replay stops at the first torn or corrupt record.
+// Appends only copy into the mapping, a committer thread makes them durable with one fdatasync per group.
+
+class Journal{
+    private:
+        std::string path;
+        int fd = -1;
+        char* base = nullptr;
+        size_t capacity = 0;
+        size_t end = 0;//first free byte
+        uint64_t appended = 0;//sequence number of the last appended record
+        uint64_t durable = 0;//sequence number covered by the last sync
+        bool syncing = false;
+        bool stopping = false;
+        std::mutex mtx;
+        std::condition_variable commitCv;//wakes the committer
+        std::condition_variable durableCv;//wakes writers waiting for their group
+        std::thread committer;
+
+        void map(size_t size);
+        void reserve(size_t bytes);
+        bool read(size_t& offset, std::string& record);
+        void commitLoop();
+
+    public:
+        bool open(const std::string& fileName, std::vector<std::string>& records);//maps the file and returns every valid record in order
+        uint64_t append(const std::string& record);//returns the record's sequence number
+        void waitDurable(uint64_t sequence);//blocks until the group holding sequence has been synced
+        size_t size();
+        void compact(const std::function<std::vector<std::string>(const std::vector<std::string>&)>& reduce);//replaces the log with reduce(records)
+        ~Journal();
+};
@@ -5,45 +5,180 @@
 #include <boost/asio.hpp>
 #include <list>
 #include <mutex>
+#include <queue>
+#include <atomic>
+#include <sstream>
+#include <optional>
+#include <unordered_map>
+#include <condition_variable>
+#include <unordered_set>
+#include <map>
+#include <poll.h>
+#include <boost/graph/adjacency_list.hpp>
+#include <boost/graph/topological_sort.hpp>
 #include "loadManager.hpp"
+#include "journal.hpp"
+#include "batchSocket.hpp"
+#include "eventLoop.hpp"
 
 //by Robert Britton
 
-// g++ -std=c++20 -I. -pthread loadManager.cxx -lcurl -o loadManager
-constexpr uint16_t ClientReceivePort = 9000;
-constexpr uint16_t InitializationPort = 9999;
-constexpr uint16_t waitPort = 9001;
+// g++ -std=c++20 -I. -pthread loadManager.cxx journal.cxx batchSocket.cxx eventLoop.cxx -lcurl -o loadManager
+// ./loadManager [--port <base port>] [--parent <root manager ip>[:<root base port>]] [--peers <ip>[:<base port>],...] [--journal <file>]
+//               [--max-queued <jobs>] [--max-client-jobs <jobs>] [--gso] [--io threads|epoll|uring]
+uint16_t ClientReceivePort = 9000;//every port is an offset from the base port so several managers can share a host
+uint16_t InitializationPort = 9999;
+uint16_t waitPort = 9001;
+uint16_t serverPortStart = 9002;
+constexpr size_t maxDatagram = 65536;//batches and results between managers are bigger than a single path
+constexpr int ackTimeout = 5000;//milliseconds to wait for a client to take a result before giving up on it
+constexpr int reconcileTimeout = 10000;//milliseconds a recovered in flight job is given to report before it is queued again
+constexpr size_t compactThreshold = 8 << 20;//journal bytes before a snapshot replaces it
+constexpr double batchTarget = 10000;//microseconds of work a batching process server is given per round trip
+constexpr size_t maxBatch = 64;
+bool segmentation = false;//--gso, lets batched sockets use UDP_SEGMENT and UDP_GRO
+constexpr size_t loopWorkers = 8;//handlers that block on the journal or a client's ack run here, never on the loop thread
+EventLoop* eventLoop = nullptr;//--io epoll|uring, one thread receives for the client, registration and batching server sockets
 
 boost::asio::io_context io;
 std::mutex Clientsocket_mtx;
-boost::asio::ip::udp::socket Clientsocket(io, {boost::asio::ip::udp::v4(), ClientReceivePort});
-boost::asio::ip::udp::socket waitSocket(io, {boost::asio::ip::udp::v4(), waitPort});
+boost::asio::ip::udp::socket Clientsocket(io);//bound in main once the base port is known
+boost::asio::ip::udp::socket waitSocket(io);//clients send NEXT RESULT here, read only by receiveAcks
+struct AckWait{
+    size_t waiters = 0;
+    size_t acks = 0;
+};
+std::mutex acks_mtx;
+std::condition_variable acksCv;
+std::map<boost::asio::ip::udp::endpoint, AckWait> pendingAcks;//by client endpoint, an ack nobody waits for is dropped
+boost::asio::ip::udp::socket InitializationSocket(io);//process servers register here, peer shards trade leases here too
 template <typename T>
 class SafeQueue{
     private:
         std::condition_variable cv;
         std::mutex mtx;
-        std::queue<T> queue;
+        std::deque<T> queue;
 
     public:
     void add(T obj){
         std::lock_guard<std::mutex> lock(mtx);
-        queue.push(obj);
-        cv.notify_one();//unblocks get when something is pushed 
+        queue.push_back(obj);
+        cv.notify_one();//unblocks get when something is pushed
     }
     T get(){
         std::unique_lock<std::mutex> lock(mtx);
-        if(queue.empty()){
+        while(queue.empty()){
             cv.wait(lock);//blocks until something is pushed
         }
         T obj = queue.front();
-        queue.pop();
+        queue.pop_front();
+        return obj;
+    }
+    std::optional<T> get(std::chrono::milliseconds timeout){//like get but gives up after timeout
+        std::unique_lock<std::mutex> lock(mtx);
+        if(!cv.wait_for(lock, timeout, [this]{ return !queue.empty(); }))return std::nullopt;
+        T obj = queue.front();
+        queue.pop_front();
         return obj;
     }
+    template <typename Predicate>
+    std::vector<T> take(Predicate predicate, size_t max){//removes up to max queued items matching predicate without blocking
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<T> taken;
+        for(auto it = queue.begin(); it != queue.end() && taken.size() < max;){
+            if(predicate(*it)){
+                taken.push_back(*it);
+                it = queue.erase(it);
+            }
+            else it++;
+        }
+        return taken;
+    }
 };
 
 SafeQueue<Client*> Clients;
 SafeQueue<ProcessServer*> serverQueue;
+SafeQueue<std::function<void()>> loopWork;//filled by event loop handlers
+std::mutex servers_mtx;
+std::list<ProcessServer*> servers;//every process server and sub-manager, used to build capacity summaries
+std::mutex liveClients_mtx;
+std::unordered_set<Client*> liveClients;//every client not yet retired, searched by CANCEL
+std::atomic<uint64_t> jobCounter = 0;
+std::atomic<size_t> clientCounter = 0;
+std::atomic<uint16_t> serverCounter = 0;
+std::vector<boost::asio::ip::udp::endpoint> peers;//other shards that can lend or borrow idle process servers
+std::mutex leased_mtx;
+std::unordered_map<std::string, ProcessServer*> leasedServers;//servers borrowed from peers, reused by endpoint across leases
+constexpr auto leaseTime = std::chrono::seconds(2);
+constexpr auto leaseGrace = std::chrono::seconds(1);//owner reclaims a lent server this long after expiry if it never came back
+
+size_t maxQueuedJobs = 200000;//jobs waiting or running for every client together, --max-queued
+size_t maxClientJobs = 50000;//the same limit for the clients of one host, --max-client-jobs
+size_t queuedJobs = 0;
+std::unordered_map<std::string, size_t> queuedByHost;
+std::mutex admission_mtx;
+std::mutex submissions_mtx;
+std::unordered_map<std::string, std::string> seenSubmissions;//SUBMISSION id to the reply it got, empty while it is still being accepted
+std::deque<std::string> seenOrder;//oldest first, so the map stays bounded
+constexpr size_t maxSeenSubmissions = 65536;
+std::atomic<size_t> completedJobs = 0;//completions since the drain meter last looked
+std::atomic<double> drainRate = 0;//jobs finished per second, smoothed
+
+struct UsageTotals{//what the jobs of one executable or one client host have cost, from the stats process servers send with results
+    size_t jobs = 0;
+    double userSeconds = 0;
+    double systemSeconds = 0;
+    long long peakRSS = 0;//kilobytes, the largest single job
+    long long rssSum = 0;
+    long long minorFaults = 0;
+    long long majorFaults = 0;
+    long long voluntarySwitches = 0;
+    long long involuntarySwitches = 0;
+    size_t countedJobs = 0;//jobs that came with hardware counters
+    long long cycles = 0;
+    long long instructions = 0;
+};
+std::map<std::string, UsageTotals> usageByExecutable;
+std::map<std::string, UsageTotals> usageByHost;
+std::mutex usage_mtx;
+LoadManager* parentManager = nullptr;//set when this manager is a leaf of a bigger tree
+Journal* journal = nullptr;//write ahead log of submits, dispatches and completions, null unless --journal is given
+
+uint64_t journalRecord(const std::string& record){//appends without waiting, the group commit makes it durable shortly after
+    return journal == nullptr ? 0 : journal->append(record);
+}
+
+bool waitReadable(boost::asio::ip::udp::socket& socket, int milliseconds){//true once a datagram is ready to read
+    pollfd descriptor = {socket.native_handle(), POLLIN, 0};
+    return poll(&descriptor, 1, milliseconds) > 0;
+}
+
+void expectAck(const boost::asio::ip::udp::endpoint& client){//registered before the result is sent so a fast ack is not dropped
+    std::lock_guard<std::mutex> lock(acks_mtx);
+    pendingAcks[client].waiters++;
+}
+
+bool awaitAck(const boost::asio::ip::udp::endpoint& client, int milliseconds){//only this client's sender waits, others keep delivering
+    std::unique_lock<std::mutex> lock(acks_mtx);
+    AckWait& wait = pendingAcks[client];
+    bool acked = acksCv.wait_for(lock, std::chrono::milliseconds(milliseconds), [&]{ return wait.acks > 0; });
+    if(acked)wait.acks--;
+    if(--wait.waiters == 0)pendingAcks.erase(client);
+    return acked;
+}
+
+void receiveAcks(){
+    std::array<char, 64> buf;
+    while(true){
+        boost::asio::ip::udp::endpoint client;
+        waitSocket.receive_from(boost::asio::buffer(buf), client);
+        std::lock_guard<std::mutex> lock(acks_mtx);
+        auto wait = pendingAcks.find(client);
+        if(wait == pendingAcks.end())continue;//late ack for a result already given up on
+        wait->second.acks++;
+        acksCv.notify_all();
+    }
+}
 class ProcessorList{
     private:
         std::mutex mtx;
@@ -75,47 +210,433 @@ class Process{
         std::string processServerID;
         std::string processServerIP;
         uint16_t processServerPort;
+        long long pointIndex = -1;//position in the parameter sweep this job was expanded from
+        std::string tag;//chosen by the client, sent back in front of the result so a session with many jobs can match them
+        std::string slot;//"core", "node" or a core count asked for with SLOT, passed to process servers that pin jobs
 
         Process(std::string name, std::string id, std::string path, std::string arguments, std::string status, std::string serverID, std::string serverIP, uint16_t serverPort):
         processName(name), processID(id), processPath(path), processArguments(arguments), processStatus(status), processServerID(serverID), processServerIP(serverIP), processServerPort(serverPort) {
         }
+
+        Process(std::string id, std::string path):
+        Process(path, id, path, "", "QUEUED", "", "", 0) {
+        }
+
+        std::string command() const{//what the process server runs
+            return processArguments.empty() ? processPath : processPath + " " + processArguments;
+        }
+};
+
+class Sweep{//command template expanded one point at a time, {a..b}, {a..b..step} and {x,y,z} placeholders are multiplied together
+    private:
+        struct Dimension{
+            bool isRange = false;
+            long long start = 0;
+            long long step = 1;
+            std::vector<std::string> values;
+            size_t size = 0;
+        };
+        std::vector<std::string> literals;//text around the placeholders, one more than dimensions
+        std::vector<Dimension> dimensions;
+    public:
+        size_t total = 1;
+        size_t next = 0;//next point to hand out, the only state that grows with the sweep
+        size_t number = 0;//position among the client's sweeps, part of each point's process id
+        std::unordered_set<size_t> skip;//points past next that already finished before a restart
+
+        explicit Sweep(const std::string& pattern){//throws std::invalid_argument on a malformed template
+            size_t position = 0;
+            while(true){
+                size_t open = pattern.find('{', position);
+                if(open == std::string::npos){
+                    literals.push_back(pattern.substr(position));
+                    break;
+                }
+                size_t close = pattern.find('}', open);
+                if(close == std::string::npos)throw std::invalid_argument("unclosed {");
+                literals.push_back(pattern.substr(position, open - position));
+                std::string body = pattern.substr(open + 1, close - open - 1);
+                Dimension dimension;
+                if(body.find("..") != std::string::npos){
+                    dimension.isRange = true;
+                    long long end = 0;
+                    size_t first = body.find("..");
+                    size_t second = body.find("..", first + 2);
+                    dimension.start = std::stoll(body.substr(0, first));
+                    end = std::stoll(body.substr(first + 2, second == std::string::npos ? std::string::npos : second - first - 2));
+                    if(second != std::string::npos)dimension.step = std::stoll(body.substr(second + 2));
+                    if(dimension.step == 0 || (end - dimension.start) / dimension.step < 0)throw std::invalid_argument("empty range {" + body + "}");
+                    dimension.size = (end - dimension.start) / dimension.step + 1;
+                }
+                else{
+                    std::istringstream list(body);
+                    std::string value;
+                    while(std::getline(list, value, ','))dimension.values.push_back(value);
+                    dimension.size = dimension.values.size();
+                    if(dimension.size == 0)throw std::invalid_argument("empty list {}");
+                }
+                if(total > SIZE_MAX / dimension.size)throw std::invalid_argument("too many points");
+                total *= dimension.size;
+                dimensions.push_back(dimension);
+                position = close + 1;
+            }
+        }
+
+        std::string at(size_t index) const{//the first placeholder varies slowest, like nested loops written left to right
+            std::vector<std::string> chosen(dimensions.size());
+            for(size_t d = dimensions.size(); d-- > 0;){
+                size_t digit = index % dimensions[d].size;
+                index /= dimensions[d].size;
+                chosen[d] = dimensions[d].isRange ? std::to_string(dimensions[d].start + (long long)digit * dimensions[d].step) : dimensions[d].values[digit];
+            }
+            std::string command = literals[0];
+            for(size_t d = 0; d < dimensions.size(); d++)command += chosen[d] + literals[d + 1];
+            return command;
+        }
 };
 
-class Client{//class representing client 
-    
+class LoadManager{//class representing the parent manager when this manager runs as a sub-manager
+    private:
+        std::mutex mtx;
+        boost::asio::io_context io;
+        boost::asio::ip::udp::socket socket;
+        boost::asio::ip::udp::endpoint parentEndPoint;
+        std::vector<char> buf;
+    public:
+        std::string serverAddress;
+        uint16_t serverPort;
+
+        void sendMessage(std::string message){
+            std::lock_guard<std::mutex> lock(mtx);
+            socket.send_to(boost::asio::buffer(message), parentEndPoint);
+        }
+        std::string receiveMessage(){
+            boost::asio::ip::udp::endpoint sender;
+            auto n = socket.receive_from(boost::asio::buffer(buf), sender);
+            return std::string(std::string_view(buf.data(), n));
+        }
+        void connect(){//registers like a process server, the reply comes from the socket the parent gave this group
+            socket.send_to(boost::asio::buffer(std::string("submanager")), parentEndPoint);
+            auto n = socket.receive_from(boost::asio::buffer(buf), parentEndPoint);
+            std::cout << "Connected to parent manager " << serverAddress << " (" << std::string_view(buf.data(), n) << ")" << std::endl;
+        }
+
+        LoadManager(std::string ip, uint16_t port):
+        socket(io, {boost::asio::ip::udp::v4(), 0}), parentEndPoint(boost::asio::ip::make_address(ip), port),
+        buf(maxDatagram), serverAddress(ip), serverPort(port) {
+        }
+};
+
+class Client{//class representing client
+
     public:
 
     uint16_t sendPort;
     std::string IPAddress;
     boost::asio::io_context io;
     size_t clientID;
-    std::queue<std::string> ProcessQueue;
+    std::queue<Process> ProcessQueue;
     boost::asio::ip::udp::endpoint clientEndPoint;
     std::condition_variable allProcessComplete;
+    LoadManager* parent = nullptr;//results of a batch from the parent manager go back upstream instead of to a client
+    std::mutex mtx;
+    std::mutex result_mtx;//one result outstanding at a time, the client acks each before it gets the next
+    bool scheduled = false;//true while in Clients or being dispatched, the client is only freed once it is neither
 
-    size_t processCount = 0;
+    std::atomic<size_t> processCount = 0;
 
+    typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::directedS> JobGraph;
+    JobGraph graph;//edge u -> v means v waits for u
+    std::vector<Process> graphJobs;//jobs of a DAG submission by vertex, released into ready as their dependencies finish
+    std::vector<size_t> waitingOn;
+    std::vector<size_t> criticalPath;//longest chain of jobs from a vertex to the end of the DAG
+    std::unordered_map<std::string, size_t> vertexOf;//process id to vertex
+    std::priority_queue<std::pair<size_t, size_t>> ready;//(critical path, vertex), longest chain dispatches first
+    std::deque<Sweep> sweeps;//parameter sweeps, expanded only when a slot is free
+    size_t jobNumber = 0;//process ids are <client id>.<job number> so replaying a submission gives the same ids
+    size_t sweepNumber = 0;
+    size_t running = 0;//jobs handed out and not finished or returned
+    bool cancelled = false;//every job was cancelled, results of jobs still running are dropped
+    std::unordered_set<std::string> cancelledIDs;//jobs cancelled while running, their results are dropped
 
-        int sendMessage(std::string message){
-            std::lock_guard<std::mutex> lock(Clientsocket_mtx);
-            std::string line;
-            std::array<char, 1024> buf;
-            Clientsocket.send_to(boost::asio::buffer(message), clientEndPoint);
-            auto n = waitSocket.receive_from(boost::asio::buffer(buf), clientEndPoint);
-            line =std::string(std::string_view(buf.data(), n));
-            processCount--;
-            return processCount;
+
+        void sendMessage(std::string message, const Process& process, const std::string& stats = ""){
+            if(parent != nullptr){
+                parent->sendMessage("RESULT " + process.processID + (stats.empty() ? "" : " " + stats) + "\n" + message);
+                return;
+            }
+            if(process.pointIndex >= 0)message = "[" + std::to_string(process.pointIndex) + "] " + message;
+            if(!process.tag.empty())message = "#" + process.tag + " " + message;
+            std::lock_guard<std::mutex> sending(result_mtx);
+            expectAck(clientEndPoint);
+            {
+                std::lock_guard<std::mutex> lock(Clientsocket_mtx);
+                Clientsocket.send_to(boost::asio::buffer(message), clientEndPoint);
+            }
+            awaitAck(clientEndPoint, ackTimeout);//gives up if the client is gone, e.g. results replayed for it after a restart
         }
 
-        void pushProcess(std::string process){
+        void pushProcess(Process process){
+            std::lock_guard<std::mutex> lock(mtx);
             ProcessQueue.push(process);
             processCount++;
         }
 
+        void pushSweep(const Sweep& sweep){
+            std::lock_guard<std::mutex> lock(mtx);
+            sweeps.push_back(sweep);
+            sweeps.back().number = sweepNumber++;
+            processCount += sweep.total;
+        }
+
+        std::string newProcessID(){
+            return std::to_string(clientID) + "." + std::to_string(jobNumber++);
+        }
+
+        Process sweepProcess(const Sweep& sweep, size_t index){
+            std::string command = sweep.at(index);
+            size_t space = command.find(' ');
+            Process process(std::to_string(clientID) + ".s" + std::to_string(sweep.number) + "." + std::to_string(index), command.substr(0, space));
+            if(space != std::string::npos)process.processArguments = command.substr(space + 1);
+            process.pointIndex = index;
+            return process;
+        }
+
+        void returnProcess(Process process){//puts back a job that was taken but never ran
+            std::lock_guard<std::mutex> lock(mtx);
+            running--;
+            if(cancelled){
+                processCount--;
+                return;
+            }
+            ProcessQueue.push(process);
+        }
+
+        size_t cancel(const std::function<bool(const Process&)>& match, bool all, bool& finished){//drops waiting jobs, returns how many
+            std::lock_guard<std::mutex> lock(mtx);
+            size_t dropped = 0;
+            std::queue<Process> remaining;
+            while(!ProcessQueue.empty()){
+                if(all || match(ProcessQueue.front()))dropped++;
+                else remaining.push(ProcessQueue.front());
+                ProcessQueue.pop();
+            }
+            ProcessQueue.swap(remaining);
+            if(all){//DAG jobs not released yet and sweep points not expanded yet go too
+                cancelled = true;
+                dropped = processCount - running;
+                ready = {};
+                sweeps.clear();
+            }
+            processCount -= dropped;
+            finished = processCount == 0 && !scheduled;
+            return dropped;
+        }
+
+        void cancelRunning(const std::string& id){
+            std::lock_guard<std::mutex> lock(mtx);
+            cancelledIDs.insert(id);
+        }
+
+        bool resultWanted(const Process& process){//false for a job cancelled while it ran
+            std::lock_guard<std::mutex> lock(mtx);
+            return !cancelledIDs.erase(process.processID) && !cancelled;
+        }
+
+        void restoreCompleted(const std::unordered_set<std::string>& done, const std::map<size_t, size_t>& watermarks){//drops jobs a journal says already finished
+            std::lock_guard<std::mutex> lock(mtx);
+            std::queue<Process> remaining;
+            while(!ProcessQueue.empty()){
+                if(done.count(ProcessQueue.front().processID))processCount--;
+                else remaining.push(ProcessQueue.front());
+                ProcessQueue.pop();
+            }
+            ProcessQueue.swap(remaining);
+            if(!graphJobs.empty()){
+                std::vector<bool> finished(graphJobs.size(), false);
+                for(size_t v = 0; v < graphJobs.size(); v++){
+                    if(!done.count(graphJobs[v].processID))continue;
+                    finished[v] = true;
+                    processCount--;
+                    for(auto edges = boost::out_edges(v, graph); edges.first != edges.second; edges.first++)waitingOn[boost::target(*edges.first, graph)]--;
+                }
+                ready = {};
+                for(size_t v = 0; v < graphJobs.size(); v++){
+                    if(!finished[v] && waitingOn[v] == 0)ready.push({criticalPath[v], v});
+                }
+            }
+            for(Sweep& sweep : sweeps){
+                auto watermark = watermarks.find(sweep.number);
+                if(watermark != watermarks.end()){
+                    sweep.next = watermark->second;
+                    processCount -= watermark->second;
+                }
+                std::string prefix = std::to_string(clientID) + ".s" + std::to_string(sweep.number) + ".";
+                for(const std::string& id : done){
+                    if(id.rfind(prefix, 0) != 0)continue;
+                    size_t index = std::stoull(id.substr(prefix.size()));
+                    if(index >= sweep.next && sweep.skip.insert(index).second)processCount--;
+                }
+            }
+        }
+
+        std::optional<Process> takeProcess(const std::string& id){//removes a waiting job by id, used to reconcile jobs in flight at a crash
+            std::lock_guard<std::mutex> lock(mtx);//taken and counted as running under one lock, so a cancel never sees it as both
+            std::optional<Process> found = takeWaiting(id);
+            if(found)running++;
+            return found;
+        }
+
+        bool hasProcess(){
+            std::lock_guard<std::mutex> lock(mtx);
+            return !ProcessQueue.empty() || !ready.empty() || !sweeps.empty();
+        }
+
+        size_t waitingProcesses(){
+            std::lock_guard<std::mutex> lock(mtx);
+            size_t waiting = ProcessQueue.size() + ready.size();
+            for(const Sweep& sweep : sweeps)waiting += sweep.total - sweep.next;
+            return waiting;
+        }
+
+        std::optional<Process> nextProcess(){//plain jobs in submission order, then released DAG jobs by critical path
+            std::lock_guard<std::mutex> lock(mtx);
+            std::optional<Process> next = nextWaiting();
+            if(next)running++;
+            return next;
+        }
+
+        std::string buildGraph(const std::vector<std::pair<Process, std::vector<std::string>>>& jobs){//returns an error, empty if the DAG is valid
+            std::unordered_map<std::string, size_t> vertexByName;
+            for(auto& job : jobs){
+                if(vertexByName.count(job.first.processName))return "duplicate job " + job.first.processName;
+                vertexByName[job.first.processName] = graphJobs.size();
+                vertexOf[job.first.processID] = graphJobs.size();
+                graphJobs.push_back(job.first);
+            }
+            graph = JobGraph(graphJobs.size());
+            waitingOn.assign(graphJobs.size(), 0);
+            for(size_t v = 0; v < jobs.size(); v++){
+                for(const std::string& dependency : jobs[v].second){
+                    if(!vertexByName.count(dependency))return jobs[v].first.processName + " depends on unknown job " + dependency;
+                    boost::add_edge(vertexByName[dependency], v, graph);
+                    waitingOn[v]++;
+                }
+            }
+            std::vector<size_t> order;
+            try{
+                boost::topological_sort(graph, std::back_inserter(order));//sinks come first
+            }
+            catch(boost::not_a_dag&){
+                return "dependency cycle";
+            }
+            criticalPath.assign(graphJobs.size(), 1);
+            for(size_t v : order){
+                for(auto edges = boost::out_edges(v, graph); edges.first != edges.second; edges.first++){
+                    criticalPath[v] = std::max(criticalPath[v], criticalPath[boost::target(*edges.first, graph)] + 1);
+                }
+            }
+            for(size_t v = 0; v < graphJobs.size(); v++){
+                if(waitingOn[v] == 0)ready.push({criticalPath[v], v});
+            }
+            processCount += graphJobs.size();
+            return "";
+        }
+
+        bool completeProcess(const Process& process, bool& released){//true once every job has finished and nothing still holds the client
+            std::lock_guard<std::mutex> lock(mtx);
+            auto vertex = vertexOf.find(process.processID);
+            released = false;
+            running--;
+            if(vertex != vertexOf.end() && !cancelled){
+                for(auto edges = boost::out_edges(vertex->second, graph); edges.first != edges.second; edges.first++){
+                    size_t next = boost::target(*edges.first, graph);
+                    if(--waitingOn[next] == 0){
+                        ready.push({criticalPath[next], next});
+                        released = true;
+                    }
+                }
+            }
+            return --processCount == 0 && !scheduled;
+        }
+
         Client(size_t id,std::string ip, uint16_t sendPort):
-        clientID(id), IPAddress(ip),sendPort(sendPort),
+        sendPort(sendPort), IPAddress(ip), clientID(id),
         clientEndPoint(boost::asio::ip::make_address(ip), sendPort) // Properly initialize the endpoint
-        {}
+        {
+            std::lock_guard<std::mutex> lock(liveClients_mtx);
+            liveClients.insert(this);
+        }
+
+        Client(size_t id, LoadManager* parent):
+        sendPort(parent->serverPort), IPAddress(parent->serverAddress), clientID(id), parent(parent)
+        {
+            std::lock_guard<std::mutex> lock(liveClients_mtx);
+            liveClients.insert(this);
+        }
+
+        ~Client(){
+            std::lock_guard<std::mutex> lock(liveClients_mtx);
+            liveClients.erase(this);
+        }
+
+    private:
+
+        std::optional<Process> takeWaiting(const std::string& id){//called with mtx held
+            std::optional<Process> found;
+            std::queue<Process> remaining;
+            while(!ProcessQueue.empty()){
+                if(!found && ProcessQueue.front().processID == id)found = ProcessQueue.front();
+                else remaining.push(ProcessQueue.front());
+                ProcessQueue.pop();
+            }
+            ProcessQueue.swap(remaining);
+            if(found)return found;
+            auto vertex = vertexOf.find(id);
+            if(vertex != vertexOf.end()){
+                std::priority_queue<std::pair<size_t, size_t>> kept;
+                while(!ready.empty()){
+                    if(ready.top().second == vertex->second)found = graphJobs[vertex->second];
+                    else kept.push(ready.top());
+                    ready.pop();
+                }
+                ready.swap(kept);
+                return found;
+            }
+            for(Sweep& sweep : sweeps){
+                std::string prefix = std::to_string(clientID) + ".s" + std::to_string(sweep.number) + ".";
+                if(id.rfind(prefix, 0) != 0)continue;
+                size_t index = std::stoull(id.substr(prefix.size()));
+                if(index < sweep.next || !sweep.skip.insert(index).second)return std::nullopt;
+                return sweepProcess(sweep, index);
+            }
+            return std::nullopt;
+        }
+
+        std::optional<Process> nextWaiting(){//called with mtx held
+            if(!ProcessQueue.empty()){
+                Process process = ProcessQueue.front();
+                ProcessQueue.pop();
+                return process;
+            }
+            if(!ready.empty()){
+                size_t vertex = ready.top().second;
+                ready.pop();
+                return graphJobs[vertex];
+            }
+            while(!sweeps.empty()){
+                Sweep& sweep = sweeps.front();
+                while(sweep.next < sweep.total && sweep.skip.erase(sweep.next))sweep.next++;
+                if(sweep.next == sweep.total){
+                    sweeps.pop_front();
+                    continue;
+                }
+                Process process = sweepProcess(sweep, sweep.next++);
+                if(sweep.next == sweep.total && sweep.skip.empty())sweeps.pop_front();
+                return process;
+            }
+            return std::nullopt;
+        }
 };
 
 
@@ -130,16 +651,36 @@ class ProcessServer{//class representing a ProcessServer
         boost::asio::ip::udp::socket socket;
         boost::asio::ip::udp::endpoint serverEndPoint;
 
+        bool isManager = false;//a sub-manager stands in for its whole group of process servers
+        bool batching = false;//a process server that takes BATCH messages and answers with coalesced RESULTS
+        size_t slots = 1;//jobs that can run at once, the group's total capacity for a sub-manager, the batch size for a batching server
+        double jobTime = batchTarget;//microseconds per job, smoothed, sizes a batching server's batches
+        size_t inFlight = 0;
+        size_t cores = 1;//jobs a process server started with --pin runs at once
+        std::string topology;//cores=<n> threads=<n> nodes=<n>,... as the process server reported it, empty if it does not pin
+        Client* runningClient = nullptr;//job a plain process server is running, so a CANCEL can be passed on
+        std::optional<Process> runningProcess;
+        bool queued = false;//true while sitting in serverQueue so a group is only queued once
+        std::mutex mtx;
+        std::unordered_map<std::string, std::pair<Client*, Process>> pending;//jobs sent in batches by id
+
+        bool leased = false;//borrowed from the peer shard at leaseOwner
+        bool lent = false;//registered here but currently lent to the peer shard at leaseHolder
+        boost::asio::ip::udp::endpoint leaseOwner;
+        boost::asio::ip::udp::endpoint leaseHolder;
+        std::chrono::steady_clock::time_point leaseExpiry;
+
         void sendMessage(std::string message){
-            socket.send_to(boost::asio::buffer(message), serverEndPoint);
+            if(eventLoop != nullptr)eventLoop->send(socket, std::move(message), serverEndPoint);//batched with the loop's other sends
+            else socket.send_to(boost::asio::buffer(message), serverEndPoint);
         }
         std::string receiveMessage(std::string message){
             socket.send_to(boost::asio::buffer(message), serverEndPoint);
-            std::array<char, 1024> buf;
+            std::vector<char> buf(maxDatagram);
             auto n = socket.receive_from(boost::asio::buffer(buf), serverEndPoint);
             return std::string(std::string_view(buf.data(), n));
         }
-        
+
         ProcessServer(uint16_t id,std::string ip, uint16_t sendPort,uint16_t receivePort):
         processServerID(id), IPAddress(ip), receivePort(receivePort), sendPort(sendPort),
 
@@ -148,22 +689,6 @@ class ProcessServer{//class representing a ProcessServer
         }
 };
 
-class LoadManager{
-    private:
-        int loadManagerID;
-        ProcessServer* processServer;
-        std::string serverAddress;
-        int serverPort;
-    public:
-        std::string addProcess(Process process){
-            // Add process to the server
-            // This function will be called when a request is received from the client
-            // It will parse the request and call the appropriate function
-            // For example, if the request is to add a process, it will call the addProcess function
-            return "";
-        }
-};
-
 CURL *curl = curl_easy_init();
 
 size_t write_callback(char *contents, size_t size, size_t nmemb, std::string *response) {
@@ -172,76 +697,1034 @@ size_t write_callback(char *contents, size_t size, size_t nmemb, std::string *re
     return total_size;
 }
 
+void requeueServer(ProcessServer* server){//puts a server back in serverQueue if it has a free slot and is not already waiting there
+    {
+        std::lock_guard<std::mutex> lock(server->mtx);
+        if(server->queued || server->lent || server->inFlight >= server->slots)return;
+        server->queued = true;
+    }
+    serverQueue.add(server);//outside the server lock, serverQueue.take locks servers while holding the queue
+}
+
+std::pair<size_t, size_t> capacitySummary(){//free and total slots over every process server and sub-manager below this one
+    size_t freeSlots = 0;
+    size_t totalSlots = 0;
+    std::lock_guard<std::mutex> lock(servers_mtx);
+    for(ProcessServer* server : servers){
+        std::lock_guard<std::mutex> serverLock(server->mtx);
+        if(server->lent)continue;
+        totalSlots += server->slots;
+        if(server->inFlight < server->slots)freeSlots += server->slots - server->inFlight;
+    }
+    return {freeSlots, totalSlots};
+}
+
+void scheduleClient(Client* client){//queues a client for dispatch unless it is already queued or being dispatched
+    {
+        std::lock_guard<std::mutex> lock(client->mtx);
+        if(client->scheduled)return;
+        client->scheduled = true;
+    }
+    Clients.add(client);
+}
+
+void reserveAdmission(const std::string& host, size_t jobs){//called with admission_mtx held
+    queuedJobs += jobs;
+    queuedByHost[host] += jobs;
+}
+
+void releaseAdmission(const std::string& host, size_t jobs){
+    std::lock_guard<std::mutex> lock(admission_mtx);
+    queuedJobs -= jobs;
+    auto queued = queuedByHost.find(host);
+    if(queued == queuedByHost.end())return;
+    queued->second -= jobs;
+    if(queued->second == 0)queuedByHost.erase(queued);
+}
+
+std::string admit(Client* client){//empty if the client fits under the limits, otherwise the reply it gets instead of being initialized
+    size_t jobs = client->processCount;
+    if(jobs > maxClientJobs)return "ADMISSION REJECTED: " + std::to_string(jobs) + " jobs is more than the limit of " + std::to_string(maxClientJobs);
+    std::lock_guard<std::mutex> lock(admission_mtx);
+    size_t hostQueued = queuedByHost.count(client->IPAddress) ? queuedByHost[client->IPAddress] : 0;
+    size_t excess = 0;//jobs that have to finish before this client fits
+    if(queuedJobs + jobs > maxQueuedJobs)excess = queuedJobs + jobs - maxQueuedJobs;
+    if(hostQueued + jobs > maxClientJobs)excess = std::max(excess, hostQueued + jobs - maxClientJobs);
+    if(excess == 0){
+        reserveAdmission(client->IPAddress, jobs);
+        return "";
+    }
+    double rate = drainRate.load();
+    long long wait = rate < 0.01 ? 1000 : (long long)(excess / rate * 1000);//nothing has finished lately, so just check back soon
+    return "RETRY-AFTER " + std::to_string(std::clamp<long long>(wait, 100, 30000));
+}
+
+void drainMeter(){//smooths the completion rate that RETRY-AFTER replies are computed from
+    while(true){
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        double rate = completedJobs.exchange(0) * 4.0;
+        drainRate.store(drainRate.load() * 0.75 + rate * 0.25);
+    }
+}
+
+void retireClient(Client* client){//deletes client after all results have been sent to client
+    if(client->parent == nullptr)journalRecord("E " + std::to_string(client->clientID));
+    delete client;
+}
+
+std::string takeStats(std::string& output){//a plain process server puts "STATS <stats>" on the first line of its result
+    if(output.rfind("STATS ", 0) != 0)return "";
+    size_t lineEnd = output.find('\n');
+    std::string stats = output.substr(6, lineEnd == std::string::npos ? std::string::npos : lineEnd - 6);
+    output.erase(0, lineEnd == std::string::npos ? output.size() : lineEnd + 1);
+    return stats;
+}
+
+void recordUsage(Client* client, const Process& process, const std::string& stats){//adds one job's user=..,sys=..,rss=.. stats to the totals
+    if(stats.empty())return;
+    std::unordered_map<std::string, double> values;
+    std::istringstream pairs(stats);
+    std::string pair;
+    while(std::getline(pairs, pair, ',')){
+        size_t equals = pair.find('=');
+        if(equals != std::string::npos)values[pair.substr(0, equals)] = std::atof(pair.c_str() + equals + 1);
+    }
+    std::string command = process.command();
+    std::string executable = command.substr(0, command.find(' '));
+    std::lock_guard<std::mutex> lock(usage_mtx);
+    for(UsageTotals* totals : {&usageByExecutable[executable], &usageByHost[client->IPAddress]}){
+        totals->jobs++;
+        totals->userSeconds += values["user"];
+        totals->systemSeconds += values["sys"];
+        totals->peakRSS = std::max(totals->peakRSS, (long long)values["rss"]);
+        totals->rssSum += values["rss"];
+        totals->minorFaults += values["minflt"];
+        totals->majorFaults += values["majflt"];
+        totals->voluntarySwitches += values["nvcsw"];
+        totals->involuntarySwitches += values["nivcsw"];
+        if(values.count("instructions")){
+            totals->countedJobs++;
+            totals->cycles += values["cycles"];
+            totals->instructions += values["instructions"];
+        }
+    }
+}
+
+std::string usageReport(){//answer to a STATS datagram, one line per executable and per client host
+    std::ostringstream report;
+    auto lines = [&](const std::string& kind, const std::map<std::string, UsageTotals>& totals){
+        for(auto& [name, total] : totals){
+            if(report.tellp() > (std::streamoff)(maxDatagram - 1024))break;
+            report << kind << " " << name << " jobs=" << total.jobs << " user=" << total.userSeconds << "s sys=" << total.systemSeconds
+                   << "s cpu/job=" << (total.userSeconds + total.systemSeconds) * 1000 / total.jobs << "ms"
+                   << " peak_rss=" << total.peakRSS << "KB avg_rss=" << total.rssSum / (long long)total.jobs << "KB"
+                   << " minflt=" << total.minorFaults << " majflt=" << total.majorFaults
+                   << " vcsw=" << total.voluntarySwitches << " ivcsw=" << total.involuntarySwitches;
+            if(total.countedJobs > 0){
+                report << " cycles=" << total.cycles << " instructions=" << total.instructions
+                       << " ipc=" << (total.cycles > 0 ? (double)total.instructions / total.cycles : 0.0);
+            }
+            report << "\n";
+        }
+    };
+    std::lock_guard<std::mutex> lock(usage_mtx);
+    lines("executable", usageByExecutable);
+    lines("host", usageByHost);
+    std::string text = report.str();
+    return text.empty() ? "no jobs finished yet\n" : text;
+}
+
+void finishProcess(Client* client, const std::string& output, const Process& process, const std::string& stats){//forwards a result and releases jobs waiting on it
+    recordUsage(client, process, stats);
+    if(client->parent != nullptr || client->resultWanted(process))client->sendMessage(output, process, stats);//a parent manager still needs the result to free its slot
+    if(client->parent == nullptr){
+        journalRecord("F " + std::to_string(client->clientID) + " " + process.processID);
+        releaseAdmission(client->IPAddress, 1);
+    }
+    completedJobs++;
+    bool released = false;
+    if(client->completeProcess(process, released)){
+        retireClient(client);
+        return;
+    }
+    if(released)scheduleClient(client);
+}
+
+void cancelJobs(const std::function<bool(Client*)>& owns, const std::function<bool(const Process&)>& match, bool all, const std::string& record){//drops matching waiting jobs and stops matching running ones
+    std::vector<Client*> finished;
+    std::vector<std::pair<ProcessServer*, std::string>> messages;
+    {
+        std::lock_guard<std::mutex> lock(liveClients_mtx);
+        for(Client* client : liveClients){
+            if(!owns(client))continue;
+            bool done = false;
+            size_t dropped = client->cancel(match, all, done);
+            if(client->parent == nullptr){//replayed after a restart so cancelled jobs are not run again
+                journalRecord("C " + std::to_string(client->clientID) + record);
+                releaseAdmission(client->IPAddress, dropped);
+            }
+            if(done)finished.push_back(client);
+        }
+        std::lock_guard<std::mutex> serversLock(servers_mtx);
+        for(ProcessServer* server : servers){
+            std::lock_guard<std::mutex> serverLock(server->mtx);
+            std::string ids;
+            for(auto& [id, job] : server->pending){//batched jobs are cancelled by the id they were sent with
+                if(!owns(job.first) || !(all || match(job.second)))continue;
+                ids += " " + id;
+                job.first->cancelRunning(job.second.processID);
+            }
+            if(server->runningClient != nullptr && owns(server->runningClient) && (all || match(*server->runningProcess))){
+                ids = " ";//a plain process server runs one job, a bare CANCEL stops it
+                server->runningClient->cancelRunning(server->runningProcess->processID);
+            }
+            if(!ids.empty())messages.push_back({server, "CANCEL" + ids});
+        }
+    }
+    for(auto& [server, message] : messages)server->sendMessage(message);
+    for(Client* client : finished)retireClient(client);
+}
+
+void clientCancel(const std::string& message, const boost::asio::ip::udp::endpoint& sender){//CANCEL [<tag> ...] from a client, no tags cancels everything it submitted
+    std::istringstream fields(message.substr(6));
+    std::unordered_set<std::string> tags;
+    std::string record;
+    std::string tag;
+    while(fields >> tag){
+        tags.insert(tag);
+        record += " " + tag;
+    }
+    std::cout << "Cancel from " << sender << (tags.empty() ? " for every job" : " for " + std::to_string(tags.size()) + " tags") << std::endl;
+    cancelJobs([&](Client* client){ return client->parent == nullptr && client->clientEndPoint == sender; },
+               [&](const Process& process){ return tags.count(process.tag) > 0; }, tags.empty(), record);
+}
+
+void batchResult(ProcessServer* server, const std::string& id, const std::string& output, const std::string& stats){//finishes one job of a batch
+    Client* client = nullptr;
+    std::optional<Process> process;
+    {
+        std::lock_guard<std::mutex> lock(server->mtx);
+        auto job = server->pending.find(id);
+        if(job == server->pending.end())return;//duplicate or unknown result
+        client = job->second.first;
+        process = job->second.second;
+        server->pending.erase(job);
+        server->inFlight--;
+    }
+    requeueServer(server);
+    finishProcess(client, output, *process, stats);
+}
+
+void serverMessage(ProcessServer* server, const std::string& message){//a result or capacity summary from a sub-manager or a batching process server
+    size_t headerEnd = message.find('\n');
+    std::string header = message.substr(0, headerEnd);
+    if(header.rfind("CAPACITY ", 0) == 0){
+        size_t freeSlots = 0;
+        size_t totalSlots = 0;
+        std::istringstream(header.substr(9)) >> freeSlots >> totalSlots;
+        {
+            std::lock_guard<std::mutex> lock(server->mtx);
+            server->slots = totalSlots;//in flight jobs are tracked here so only the group size is needed
+        }
+        requeueServer(server);
+    }
+    else if(header.rfind("RESULT ", 0) == 0){//RESULT <id> [<stats>]
+        std::istringstream fields(header.substr(7));
+        std::string id, stats;
+        fields >> id >> stats;
+        batchResult(server, id, headerEnd == std::string::npos ? "" : message.substr(headerEnd + 1), stats);
+    }
+    else if(header.rfind("RESULTS ", 0) == 0){//<id>\t<output length>\t<microseconds>\t<stats>\n<output> for each coalesced result
+        std::vector<std::tuple<std::string, std::string, std::string>> results;
+        double microseconds = 0;
+        size_t offset = headerEnd + 1;
+        while(headerEnd != std::string::npos && offset < message.size()){
+            size_t lineEnd = message.find('\n', offset);
+            if(lineEnd == std::string::npos)break;
+            std::istringstream fields(message.substr(offset, lineEnd - offset));
+            std::string id, stats;
+            size_t length = 0;
+            double taken = 0;
+            std::getline(fields, id, '\t');
+            fields >> length >> taken >> stats;
+            results.push_back({id, message.substr(lineEnd + 1, length), stats});
+            microseconds += taken;
+            offset = lineEnd + 1 + length;
+        }
+        if(results.empty())return;
+        {
+            std::lock_guard<std::mutex> lock(server->mtx);//short jobs get bigger batches, long jobs go out one at a time so they spread over servers
+            server->jobTime = server->jobTime * 0.8 + microseconds / results.size() * 0.2;
+            server->slots = std::clamp<size_t>(server->cores * batchTarget / std::max(server->jobTime, 1.0), server->cores, std::max(maxBatch, server->cores));
+        }
+        for(auto& [id, output, stats] : results)batchResult(server, id, output, stats);
+    }
+}
+
+void subManagerReceive(ProcessServer* server){//receive thread for a sub-manager or a batching process server when there is no event loop
+    BatchSocket batchSocket(server->socket, 8, maxDatagram, segmentation);//every datagram already waiting is taken with one system call
+    while(true){
+        size_t received = batchSocket.receive();
+        for(size_t i = 0; i < received; i++)serverMessage(server, std::string(batchSocket.data(i)));
+    }
+}
+
+void returnLease(ProcessServer* server){//hands a borrowed server back to the shard that owns it
+    {
+        std::lock_guard<std::mutex> lock(server->mtx);
+        server->queued = false;
+        server->leaseExpiry = std::chrono::steady_clock::time_point();
+    }
+    std::string message = "RETURN " + server->IPAddress + " " + std::to_string(server->sendPort);
+    InitializationSocket.send_to(boost::asio::buffer(message), server->leaseOwner);
+}
+
+bool leaseExpired(ProcessServer* server){
+    std::lock_guard<std::mutex> lock(server->mtx);
+    return server->leased && std::chrono::steady_clock::now() >= server->leaseExpiry;
+}
+
+void releaseServer(ProcessServer* server){//called when a job finishes, expired leases go home instead of back in the queue
+    if(leaseExpired(server))returnLease(server);
+    else requeueServer(server);
+}
+
+void lendServers(size_t count, boost::asio::ip::udp::endpoint peer){//answers a peer's STEAL with idle servers that registered here
+    std::vector<ProcessServer*> idle = serverQueue.take([](ProcessServer* server){
+        std::lock_guard<std::mutex> lock(server->mtx);
+        return !server->isManager && !server->leased && server->inFlight == 0;//a batching server may be queued with jobs still running
+    }, count);
+    for(ProcessServer* server : idle){
+        {
+            std::lock_guard<std::mutex> lock(server->mtx);
+            server->queued = false;
+            server->lent = true;
+            server->leaseHolder = peer;
+            server->leaseExpiry = std::chrono::steady_clock::now() + leaseTime;
+        }
+        std::string message = "LEASE " + server->IPAddress + " " + std::to_string(server->sendPort) + " " +
+            std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(leaseTime).count());
+        InitializationSocket.send_to(boost::asio::buffer(message), peer);
+    }
+}
+
+void borrowServer(std::string ip, uint16_t port, size_t milliseconds, boost::asio::ip::udp::endpoint owner){//takes a lease granted by a peer
+    ProcessServer* server;
+    {
+        std::lock_guard<std::mutex> lock(leased_mtx);
+        std::string key = ip + ":" + std::to_string(port);
+        if(leasedServers.find(key) == leasedServers.end()){
+            uint16_t id = serverCounter++;
+            leasedServers[key] = new ProcessServer(id, ip, port, serverPortStart + id);
+        }
+        server = leasedServers[key];
+    }
+    {
+        std::lock_guard<std::mutex> lock(server->mtx);
+        server->leased = true;
+        server->leaseOwner = owner;
+        server->leaseExpiry = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+    }
+    requeueServer(server);
+}
+
+void reclaimServer(std::string ip, uint16_t port){//a peer returned a lent server
+    std::lock_guard<std::mutex> lock(servers_mtx);
+    for(ProcessServer* server : servers){
+        if(server->IPAddress != ip || server->sendPort != port)continue;
+        {
+            std::lock_guard<std::mutex> serverLock(server->mtx);
+            if(!server->lent)return;
+            server->lent = false;
+        }
+        requeueServer(server);
+        return;
+    }
+}
+
+void leaseWatchdog(){//returns idle borrowed servers once their lease runs out and reclaims lent servers a peer never returned
+    while(true){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto now = std::chrono::steady_clock::now();
+        std::vector<ProcessServer*> expired = serverQueue.take([](ProcessServer* server){
+            return leaseExpired(server);
+        }, SIZE_MAX);
+        for(ProcessServer* server : expired)returnLease(server);
+
+        std::lock_guard<std::mutex> lock(servers_mtx);
+        for(ProcessServer* server : servers){
+            bool reclaim = false;
+            {
+                std::lock_guard<std::mutex> serverLock(server->mtx);
+                if(server->lent && now > server->leaseExpiry + leaseGrace){
+                    server->lent = false;
+                    reclaim = true;
+                }
+            }
+            if(reclaim)requeueServer(server);
+        }
+    }
+}
+
+void receiveResults(ProcessServer* server){//watched by the event loop when there is one, otherwise a thread of its own
+    if(eventLoop == nullptr){
+        std::thread receiveThread(subManagerReceive, server);
+        receiveThread.detach();
+        return;
+    }
+    eventLoop->watch(server->socket, [server](std::vector<Datagram>& datagrams){
+        auto messages = std::make_shared<std::vector<Datagram>>(std::move(datagrams));
+        loopWork.add([server, messages]{//finishing a job waits on the client's ack
+            for(Datagram& datagram : *messages)serverMessage(server, datagram.data);
+        });
+    });
+}
+
+ProcessServer* addServer(uint16_t idCounter, std::string ip, uint16_t processServerPort, const std::string& registration){//also used to re-adopt servers from the journal
+    ProcessServer* processServer = new ProcessServer(idCounter,ip,processServerPort,serverPortStart+idCounter);//each process server gets its own port
+    {
+        std::lock_guard<std::mutex> lock(servers_mtx);
+        servers.push_back(processServer);
+    }
+    std::istringstream fields(registration);//<kind> [cores=<n> threads=<n> nodes=<n>,...]
+    std::string kind;
+    fields >> kind;
+    std::getline(fields >> std::ws, processServer->topology);
+    if(processServer->topology.find("cores=") != std::string::npos){
+        processServer->cores = std::max<size_t>(std::strtoull(processServer->topology.c_str() + processServer->topology.find("cores=") + 6, nullptr, 10), 1);
+        std::cout << "Process Server ID: " << idCounter << " pins jobs to slots: " << processServer->topology << std::endl;
+    }
+    if(kind == "batch"){
+        processServer->batching = true;
+        processServer->slots = processServer->cores;//a plain process server still gets one job at a time
+        std::cout<<"New Batching Process Server ID: " << idCounter << " IP: " << ip << " Port: " << processServerPort<< std::endl;
+        receiveResults(processServer);
+    }
+    else if(kind == "submanager"){
+        processServer->isManager = true;
+        processServer->slots = 0;//queued once its first capacity summary arrives
+        std::cout<<"New Sub-Manager ID: " << idCounter << " IP: " << ip << " Port: " << processServerPort<< std::endl;
+        receiveResults(processServer);
+    }
+    else{
+        std::cout<<"New Process Server ID: " << idCounter << " IP: " << ip << " Port: " << processServerPort<< std::endl;
+    }
+    return processServer;
+}
+
+void initializationMessage(const std::string& processServerdata, const boost::asio::ip::udp::endpoint& sender){//a process server registering or a peer shard trading leases
+    std::istringstream peerMessage(processServerdata);
+    std::string keyword;
+    peerMessage >> keyword;
+    if(keyword == "STEAL"){
+        size_t count = 1;
+        peerMessage >> count;
+        lendServers(count, sender);
+        return;
+    }
+    if(keyword == "LEASE" || keyword == "RETURN"){
+        std::string leaseIP;
+        uint16_t leasePort = 0;
+        size_t milliseconds = 0;
+        peerMessage >> leaseIP >> leasePort >> milliseconds;
+        if(keyword == "LEASE")borrowServer(leaseIP, leasePort, milliseconds, sender);
+        else reclaimServer(leaseIP, leasePort);
+        return;
+    }
+    uint16_t idCounter = serverCounter++;
+    ProcessServer* processServer = addServer(idCounter, sender.address().to_string(), sender.port(), processServerdata);
+    processServer->sendMessage("Process Server Initialized");//send back a message to process server to assure it has been connected
+    journalRecord("R " + std::to_string(idCounter) + " " + processServer->IPAddress + " " + std::to_string(processServer->sendPort) + " " + processServerdata);
+    if(!processServer->isManager)requeueServer(processServer);
+}
+
 void ProcessServerInitialization(){
-    uint16_t idCounter = 0;
-    boost::asio::io_context io;
-    boost::asio::ip::udp::socket InitializationSocket(io, {boost::asio::ip::udp::v4(), InitializationPort});
-    std::array<char, 1024> buf;
+    std::vector<char> buf(maxDatagram);//registrations carry the CPU topology, and peer shards share this socket
     while (true)
     {
         boost::asio::ip::udp::endpoint sender;
         auto n = InitializationSocket.receive_from(boost::asio::buffer(buf), sender);//process server connects
-        std::string processServerdata = std::string(std::string_view(buf.data(), n));
-        std::string ip = sender.address().to_string();
-        uint processServerPort = sender.port();
-        ProcessServer* processServer = new ProcessServer(idCounter,ip,processServerPort,9002+idCounter);//each process server gets its own port
-        processServer->sendMessage("Process Server Initialized");//send back a message to process server to assure it has been connected
-        std::cout<<"New Process Server ID: " << idCounter << " IP: " << ip << " Port: " << processServerPort<< std::endl;
-        serverQueue.add(processServer);
-        idCounter++;
+        initializationMessage(std::string(std::string_view(buf.data(), n)), sender);
     }
-} 
+}
 
-void clientAccept(){//function to accept client
-    size_t clientID = 0;
-    while(true){
-        std::array<char, 1024> buf;
-        boost::asio::ip::udp::endpoint clientEndPoint;
-        auto n = Clientsocket.receive_from(boost::asio::buffer(buf), clientEndPoint);
-        uint16_t clientPort = clientEndPoint.port();//gets port of client
-        std::string clientIP = clientEndPoint.address().to_string();//gets IP of client as string
-        Clientsocket.send_to(boost::asio::buffer("Client Initialized"), clientEndPoint);//send back a message to client to assure it has been connected
-        std::string clientdata = std::string(std::string_view(buf.data(), n));
+std::string takeSlot(std::string& line){//strips SLOT <core|node|cores> from the front of a line and returns the request
+    if(line.rfind("SLOT ", 0) != 0)return "";
+    size_t end = line.find(' ', 5);
+    std::string request = line.substr(5, end == std::string::npos ? std::string::npos : end - 5);
+    line = end == std::string::npos ? "" : line.substr(end + 1);
+    return request;
+}
+
+std::string parseSubmission(Client* client, std::string clientdata){//fills a client from its submission, returns an error for the client if it is invalid
+    std::vector<std::pair<Process, std::vector<std::string>>> dagJobs;
+    std::string error;
+    while(clientdata.find('\n') != std::string::npos){
+        std::string process = clientdata.substr(0, clientdata.find('\n'));
+        clientdata.erase(0, clientdata.find('\n') + 1);
+        if(process.rfind("SUBMISSION ", 0) == 0)continue;//id of a resendable submission, already handled by acceptSubmissions
+        std::string slot = takeSlot(process);//SLOT <request> <line>, the rest is any other submission line
+        if(process.rfind("DAG ", 0) == 0){//DAG <name> <dependency,dependency|-> <command>
+            std::istringstream fields(process.substr(4));
+            std::string name, dependencyList, command;
+            fields >> name >> dependencyList;
+            std::getline(fields >> std::ws, command);
+            std::vector<std::string> dependencies;
+            std::istringstream list(dependencyList == "-" ? "" : dependencyList);
+            std::string dependency;
+            while(std::getline(list, dependency, ','))dependencies.push_back(dependency);
+            Process job(client->newProcessID(), command);
+            job.processName = name;
+            job.slot = slot;
+            dagJobs.push_back({job, dependencies});
+            continue;
+        }
+        if(process.rfind("SWEEP ", 0) == 0){//SWEEP <command template>, one message no matter how many points
+            try{
+                client->pushSweep(Sweep(process.substr(6)));
+            }
+            catch(std::exception& e){
+                error = "SWEEP REJECTED: " + std::string(e.what());
+            }
+            continue;
+        }
+        if(process.rfind("TAG ", 0) == 0){//TAG <tag> <command>
+            std::istringstream fields(process.substr(4));
+            std::string tag, command;
+            fields >> tag;
+            std::getline(fields >> std::ws, command);
+            Process job(client->newProcessID(), command);
+            job.tag = tag;
+            job.slot = slot;
+            client->pushProcess(job);
+            continue;
+        }
+        Process job(client->newProcessID(), process);
+        job.slot = slot;
+        client->pushProcess(job);
+    }
+    if(error.empty() && !dagJobs.empty()){
+        error = client->buildGraph(dagJobs);
+        if(!error.empty())error = "DAG REJECTED: " + error;
+    }
+    return error;
+}
+
+std::string submissionID(const std::string& data){//SUBMISSION <id> on the first line, sent by sessions that may resend a submission
+    if(data.rfind("SUBMISSION ", 0) != 0)return "";
+    return data.substr(11, data.find('\n') - 11);
+}
+
+void rememberSubmission(const std::string& id, const std::string& reply){
+    std::lock_guard<std::mutex> lock(submissions_mtx);
+    if(seenSubmissions.find(id) == seenSubmissions.end()){
+        seenOrder.push_back(id);
+        if(seenOrder.size() > maxSeenSubmissions){
+            seenSubmissions.erase(seenOrder.front());
+            seenOrder.pop_front();
+        }
+    }
+    seenSubmissions[id] = reply;
+}
+
+std::string withSubmissionID(std::string reply, const std::string& id){//the session matches the reply by id, so a late or repeated answer cannot be taken for another submission
+    return id.empty() ? reply : reply + "\nSUBMISSION " + id;
+}
+
+std::vector<Datagram> acceptSubmissions(std::vector<Datagram>& submissions){//returns the replies for the burst, one journal sync covers all of it
+    std::vector<Datagram> replies;
+    std::vector<std::pair<Client*, std::string>> accepted;
+    uint64_t sequence = 0;
+    for(Datagram& submission : submissions){
+        if(submission.data.rfind("CANCEL", 0) == 0){//not a submission, nothing is sent back
+            clientCancel(submission.data, submission.sender);
+            continue;
+        }
+        if(submission.data == "STATS"){
+            replies.push_back({usageReport(), submission.sender});
+            continue;
+        }
+        std::string id = submissionID(submission.data);
+        if(!id.empty()){//a resend of a submission already taken is answered again, never queued twice
+            std::lock_guard<std::mutex> lock(submissions_mtx);
+            auto seen = seenSubmissions.find(id);
+            if(seen != seenSubmissions.end()){
+                if(!seen->second.empty())replies.push_back({withSubmissionID(seen->second, id), submission.sender});
+                continue;
+            }
+        }
+        uint16_t clientPort = submission.sender.port();//gets port of client
+        std::string clientIP = submission.sender.address().to_string();//gets IP of client as string
+        size_t clientID = clientCounter++;
         std::cout << "New Client ID: " << clientID << " IP: " << clientIP << " Port: " << clientPort<< std::endl;
 
         Client* client = new Client(clientID,clientIP,clientPort);
-        while(clientdata.find('\n') != std::string::npos){
-            std::string process = clientdata.substr(0, clientdata.find('\n'));
-            clientdata.erase(0, clientdata.find('\n') + 1);
-            client->pushProcess(process);
+        std::string error = parseSubmission(client, submission.data);
+        if(error.empty())error = admit(client);//over the limits the client is told when to try again rather than queued
+        if(!error.empty()){//nothing was queued, so a resend after RETRY-AFTER is a new submission
+            replies.push_back({withSubmissionID(error, id), submission.sender});
+            delete client;
+            continue;
         }
-        Clients.add(client);
-        clientID++;
-        // Process the client data
-        // This function will be called when a request is received from the client
-        // It will parse the request and call the appropriate function
+        if(!id.empty())rememberSubmission(id, "");//resends arriving during the journal sync are dropped
+        sequence = journalRecord("S " + std::to_string(clientID) + " " + clientIP + " " + std::to_string(clientPort) + "\n" + submission.data);
+        accepted.push_back({client, id});
+    }
+    if(sequence > 0)journal->waitDurable(sequence);//a client is only told it was accepted once its jobs survive a crash
+    for(auto& [client, id] : accepted){
+        std::string reply = "Client Initialized " + std::to_string(client->processCount);//the client expects this many results
+        if(!id.empty())rememberSubmission(id, reply);
+        replies.push_back({withSubmissionID(reply, id), client->clientEndPoint});
+    }
+    for(auto& [client, id] : accepted)scheduleClient(client);
+    return replies;
+}
+
+void clientAccept(){//function to accept client
+    BatchSocket batchSocket(Clientsocket, 64, segmentation ? maxDatagram : 1024, segmentation);//a burst of submissions is drained with one system call, GRO can merge a burst into one 64 KB datagram
+    while(true){
+        std::vector<Datagram> submissions;
+        size_t received = batchSocket.receive();
+        for(size_t i = 0; i < received; i++)submissions.push_back({std::string(batchSocket.data(i)), batchSocket.sender(i)});
+        for(Datagram& reply : acceptSubmissions(submissions))batchSocket.queue(std::move(reply.data), reply.sender);
+        batchSocket.flush();//every reply of the burst in one sendmmsg
     }
 }
 
-void processExecutable(std::string path,ProcessServer* server,Client* client){
+void loopWorker(){//runs what event loop handlers hand off
+    while(true)loopWork.get()();
+}
+
+void startEventLoop(){//takes over the client and registration sockets, batching servers are watched as they register
+    eventLoop->watch(Clientsocket, [](std::vector<Datagram>& datagrams){
+        auto submissions = std::make_shared<std::vector<Datagram>>(std::move(datagrams));
+        loopWork.add([submissions]{//accepting waits for the journal
+            for(Datagram& reply : acceptSubmissions(*submissions))eventLoop->send(Clientsocket, std::move(reply.data), reply.sender);
+        });
+    });
+    eventLoop->watch(InitializationSocket, [](std::vector<Datagram>& datagrams){
+        for(Datagram& datagram : datagrams){
+            auto message = std::make_shared<Datagram>(std::move(datagram));
+            loopWork.add([message]{ initializationMessage(message->data, message->sender); });
+        }
+    });
+    for(size_t i = 0; i < loopWorkers; i++){
+        std::thread worker(loopWorker);
+        worker.detach();
+    }
+    std::thread loopThread([]{ eventLoop->run(); });
+    loopThread.detach();
+    std::cout << "Event loop: " << eventLoop->name() << std::endl;
+}
+
+void parentReceive(){//receives batches of jobs from the parent manager
+    while(true){
+        std::string message = parentManager->receiveMessage();
+        if(message.rfind("CANCEL", 0) == 0){//CANCEL <id> ... with the ids the parent sent its batches with
+            std::istringstream fields(message.substr(6));
+            std::unordered_set<std::string> ids;
+            std::string id;
+            while(fields >> id)ids.insert(id);
+            cancelJobs([](Client* client){ return client->parent != nullptr; },
+                       [&](const Process& process){ return ids.count(process.processID) > 0; }, false, "");
+            continue;
+        }
+        if(message.rfind("BATCH", 0) != 0)continue;
+        Client* batch = new Client(clientCounter++, parentManager);//results of this batch go back to the parent
+        std::istringstream lines(message.substr(message.find('\n') + 1));
+        std::string line;
+        while(std::getline(lines, line)){
+            size_t tab = line.find('\t');
+            if(tab == std::string::npos)continue;
+            std::string command = line.substr(tab + 1);
+            std::string slot = takeSlot(command);
+            Process process(line.substr(0, tab), command);
+            process.slot = slot;
+            batch->pushProcess(process);
+        }
+        if(batch->processCount == 0){
+            delete batch;
+            continue;
+        }
+        scheduleClient(batch);
+    }
+}
+
+void capacityReport(){//sends the group's capacity to the parent when it changes, and periodically in case a datagram was lost
+    std::pair<size_t, size_t> last = {0, 0};
+    auto lastSent = std::chrono::steady_clock::now();
+    while(true){
+        std::pair<size_t, size_t> capacity = capacitySummary();
+        auto now = std::chrono::steady_clock::now();
+        if(capacity != last || now - lastSent > std::chrono::seconds(1)){
+            parentManager->sendMessage("CAPACITY " + std::to_string(capacity.first) + " " + std::to_string(capacity.second));
+            last = capacity;
+            lastSent = now;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
+
+void processExecutable(Process process,ProcessServer* server,Client* client){
     std::string  exeResult;
-    exeResult += server->receiveMessage(path);//send exe to run then adds to result string
-    if(client->sendMessage(exeResult)==0)delete client;//deletes client after all results have been sent to client
-    serverQueue.add(server);//pushes server back to server queue
+    exeResult += server->receiveMessage(process.command());//send exe to run then adds to result string
+    {
+        std::lock_guard<std::mutex> lock(server->mtx);
+        server->inFlight--;
+        server->runningClient = nullptr;
+        server->runningProcess.reset();
+    }
+    releaseServer(server);//pushes server back to server queue
+    std::string stats = takeStats(exeResult);
+    finishProcess(client, exeResult, process, stats);
 
 }
 
+void dispatchBatch(ProcessServer* server, Client* client){//sends as many jobs as a sub-manager or batching server has free slots in one message
+    std::string batch;
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(server->mtx);
+        server->queued = false;
+        while(server->inFlight < server->slots && batch.size() < maxDatagram / 2){
+            std::optional<Process> next = client->nextProcess();
+            if(!next)break;
+            Process process = *next;
+            std::string id = std::to_string(jobCounter++);//ids are per manager so a sub-manager can renumber its parent's jobs
+            batch += id + '\t' + (process.slot.empty() ? "" : "SLOT " + process.slot + " ") + process.command() + '\n';
+            server->pending.emplace(id, std::make_pair(client, process));
+            server->inFlight++;
+            count++;
+        }
+    }
+    if(count > 0)server->sendMessage("BATCH " + std::to_string(count) + "\n" + batch);
+    requeueServer(server);
+}
+
+ProcessServer* nextServer(size_t waiting){//blocks until a server is free, asking peer shards to lend idle servers meanwhile
+    if(peers.empty())return serverQueue.get();
+    while(true){
+        std::optional<ProcessServer*> server = serverQueue.get(std::chrono::milliseconds(50));
+        if(server)return *server;
+        std::string message = "STEAL " + std::to_string(std::min<size_t>(waiting, 4));
+        for(auto& peer : peers)InitializationSocket.send_to(boost::asio::buffer(message), peer);
+    }
+}
+
+boost::asio::ip::udp::endpoint managerEndPoint(std::string address){//<ip>[:<base port>] of another manager to the socket servers register at
+    uint16_t port = 9000;
+    if(address.find(':') != std::string::npos){
+        port = std::stoi(address.substr(address.find(':') + 1));
+        address = address.substr(0, address.find(':'));
+    }
+    return boost::asio::ip::udp::endpoint(boost::asio::ip::make_address(address), port + 999);
+}
+
 void processClient(Client* client){
-    while(!(client->ProcessQueue.empty())){
-        std::string process = client->ProcessQueue.front();
-        client->ProcessQueue.pop();
-        ProcessServer* server = serverQueue.get();//blocks until process server becomes available 
+    while(true){
+        if(!client->hasProcess()){
+            bool finished;
+            {
+                std::lock_guard<std::mutex> lock(client->mtx);
+                if(!client->ProcessQueue.empty() || !client->ready.empty() || !client->sweeps.empty())continue;//a job was released meanwhile
+                client->scheduled = false;//jobs released from now on schedule the client again
+                finished = client->processCount == 0;
+            }
+            if(finished)retireClient(client);
+            return;
+        }
+        ProcessServer* server = nextServer(client->waitingProcesses());//blocks until process server becomes available
+        if(leaseExpired(server)){
+            returnLease(server);
+            continue;
+        }
+        if(server->isManager || server->batching){
+            dispatchBatch(server, client);
+            continue;
+        }
+        std::optional<Process> next = client->nextProcess();
+        if(!next){
+            requeueServer(server);
+            continue;
+        }
+        Process process = *next;
+        {
+            std::lock_guard<std::mutex> lock(server->mtx);
+            server->queued = false;
+            server->inFlight++;
+            server->runningClient = client;
+            server->runningProcess = process;
+        }
+        if(client->parent == nullptr)journalRecord("D " + std::to_string(client->clientID) + " " + process.processID + " " + std::to_string(server->processServerID));
         std::thread processThread(processExecutable,process,server,client);//creates thread to run process
         processThread.detach();
     }
 }
 
+struct JournalState{//what the journal says is still live
+    std::map<uint16_t, std::vector<std::string>> servers;//id to ip, port and kind
+    std::map<size_t, std::string> submissions;//client id to its S record
+    std::unordered_map<size_t, std::unordered_set<std::string>> done;
+    std::unordered_map<size_t, std::map<size_t, size_t>> watermarks;//client id to sweep number to points all finished below
+    std::unordered_map<size_t, std::map<std::string, uint16_t>> dispatched;//client id to process id to server id
+    std::map<uint16_t, std::pair<size_t, std::string>> running;//process server to the only job it can still be running
+    std::unordered_map<size_t, std::vector<std::string>> cancels;//client id to the tags of each CANCEL, empty for all of them
+};
+
+JournalState readJournal(const std::vector<std::string>& records){
+    JournalState state;
+    for(const std::string& record : records){
+        std::istringstream fields(record.substr(0, record.find('\n')));
+        std::string type;
+        size_t clientID = 0;
+        fields >> type;
+        if(type == "R"){
+            uint16_t id;
+            std::string ip, port, kind;
+            fields >> id >> ip >> port;
+            std::getline(fields >> std::ws, kind);//the kind and any topology after it
+            state.servers[id] = {ip, port, kind};
+            continue;
+        }
+        fields >> clientID;
+        if(type == "S")state.submissions[clientID] = record;
+        else if(type == "E"){
+            state.submissions.erase(clientID);
+            state.done.erase(clientID);
+            state.watermarks.erase(clientID);
+            state.dispatched.erase(clientID);
+            state.cancels.erase(clientID);
+        }
+        else if(type == "F"){
+            std::string processID;
+            fields >> processID;
+            state.done[clientID].insert(processID);
+            state.dispatched[clientID].erase(processID);
+        }
+        else if(type == "D"){
+            std::string processID;
+            uint16_t serverID;
+            fields >> processID >> serverID;
+            bool isManager = state.servers.count(serverID) && state.servers[serverID][2].rfind("init", 0) != 0;//only a plain process server runs one job at a time
+            auto previous = state.running.find(serverID);
+            if(!isManager && previous != state.running.end()){//a process server runs one job at a time, so the earlier one ended and its result was lost
+                auto client = state.dispatched.find(previous->second.first);
+                if(client != state.dispatched.end())client->second.erase(previous->second.second);
+            }
+            if(!isManager)state.running[serverID] = {clientID, processID};
+            state.dispatched[clientID][processID] = serverID;
+        }
+        else if(type == "W"){
+            size_t sweep, watermark;
+            fields >> sweep >> watermark;
+            state.watermarks[clientID][sweep] = watermark;
+        }
+        else if(type == "C"){
+            std::string tags;
+            std::getline(fields, tags);
+            state.cancels[clientID].push_back(tags);
+        }
+    }
+    return state;
+}
+
+std::vector<std::string> compactJournal(const std::vector<std::string>& records){//snapshot of live state, finished clients disappear
+    JournalState state = readJournal(records);
+    std::vector<std::string> snapshot;
+    for(auto& [id, server] : state.servers)snapshot.push_back("R " + std::to_string(id) + " " + server[0] + " " + server[1] + " " + server[2]);
+    for(auto& [clientID, submission] : state.submissions){
+        snapshot.push_back(submission);
+        for(const std::string& tags : state.cancels[clientID])snapshot.push_back("C " + std::to_string(clientID) + tags);
+        std::map<size_t, size_t>& watermarks = state.watermarks[clientID];
+        std::unordered_set<std::string>& done = state.done[clientID];
+        for(auto& [sweep, watermark] : watermarks){//finished points at the front of a sweep collapse into one record
+            std::string prefix = std::to_string(clientID) + ".s" + std::to_string(sweep) + ".";
+            while(done.erase(prefix + std::to_string(watermark)))watermark++;
+        }
+        for(const std::string& processID : done){
+            size_t sweepStart = processID.find(".s");
+            if(sweepStart == std::string::npos)continue;
+            size_t sweep = std::stoull(processID.substr(sweepStart + 2));
+            if(watermarks.count(sweep))continue;
+            size_t watermark = 0;
+            std::string prefix = std::to_string(clientID) + ".s" + std::to_string(sweep) + ".";
+            while(done.count(prefix + std::to_string(watermark)))watermark++;
+            watermarks[sweep] = watermark;
+        }
+        for(auto& [sweep, watermark] : watermarks){
+            std::string prefix = std::to_string(clientID) + ".s" + std::to_string(sweep) + ".";
+            for(size_t point = 0; point < watermark; point++)done.erase(prefix + std::to_string(point));
+            snapshot.push_back("W " + std::to_string(clientID) + " " + std::to_string(sweep) + " " + std::to_string(watermark));
+        }
+        for(const std::string& processID : done)snapshot.push_back("F " + std::to_string(clientID) + " " + processID);
+        for(auto& [processID, serverID] : state.dispatched[clientID]){
+            snapshot.push_back("D " + std::to_string(clientID) + " " + processID + " " + std::to_string(serverID));
+        }
+    }
+    return snapshot;
+}
+
+void journalCompaction(){//replaces the journal with a snapshot once it grows past compactThreshold
+    while(true){
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if(journal->size() > compactThreshold)journal->compact(compactJournal);
+    }
+}
+
+void reconcileProcess(ProcessServer* server, Process process, Client* client){//waits for a job that was running when the manager stopped
+    std::vector<char> buf(maxDatagram);
+    if(waitReadable(server->socket, reconcileTimeout)){//the server answers on the same port it was given before the restart
+        auto n = server->socket.receive_from(boost::asio::buffer(buf), server->serverEndPoint);
+        {
+            std::lock_guard<std::mutex> lock(server->mtx);
+            server->inFlight--;
+        }
+        requeueServer(server);
+        std::string output(buf.data(), n);
+        std::string stats = takeStats(output);
+        finishProcess(client, output, process, stats);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(server->mtx);
+        server->inFlight--;
+    }
+    requeueServer(server);
+    client->returnProcess(process);
+    scheduleClient(client);
+}
+
+void recoverJournal(const std::vector<std::string>& records){//rebuilds servers, queued jobs and in flight jobs after a restart
+    JournalState state = readJournal(records);
+    std::unordered_map<uint16_t, ProcessServer*> recovered;
+    for(auto& [id, server] : state.servers){
+        recovered[id] = addServer(id, server[0], std::stoi(server[1]), server[2]);
+        serverCounter = std::max<uint16_t>(serverCounter, id + 1);
+    }
+    std::vector<std::tuple<ProcessServer*, Process, Client*>> reconciling;
+    for(auto& [clientID, submission] : state.submissions){
+        std::istringstream fields(submission.substr(0, submission.find('\n')));
+        std::string type, ip;
+        size_t id;
+        uint16_t port;
+        fields >> type >> id >> ip >> port;
+        clientCounter = std::max(clientCounter.load(), clientID + 1);
+        Client* client = new Client(clientID, ip, port);
+        parseSubmission(client, submission.substr(submission.find('\n') + 1));
+        std::string sessionSubmission = submissionID(submission.substr(submission.find('\n') + 1));
+        if(!sessionSubmission.empty())rememberSubmission(sessionSubmission, "Client Initialized " + std::to_string(client->processCount));//clients resend what was unanswered at the crash
+        client->restoreCompleted(state.done[clientID], state.watermarks[clientID]);
+        for(const std::string& record : state.cancels[clientID]){
+            std::istringstream fields(record);
+            std::unordered_set<std::string> tags;
+            std::string tag;
+            while(fields >> tag)tags.insert(tag);
+            bool finished;
+            client->cancel([&](const Process& process){ return tags.count(process.tag) > 0; }, tags.empty(), finished);
+        }
+        {
+            std::lock_guard<std::mutex> lock(admission_mtx);
+            reserveAdmission(ip, client->processCount);//already accepted once, so it is never turned away
+        }
+        for(auto& [processID, serverID] : state.dispatched[clientID]){
+            auto server = recovered.find(serverID);
+            if(server == recovered.end() || server->second->isManager || server->second->batching)continue;//batched jobs are simply queued again
+            std::optional<Process> process = client->takeProcess(processID);
+            if(!process)continue;
+            server->second->inFlight++;
+            reconciling.push_back({server->second, *process, client});
+        }
+        std::cout << "Recovered Client ID: " << clientID << " with " << client->processCount << " unfinished jobs" << std::endl;
+        if(client->processCount == 0)retireClient(client);
+        else scheduleClient(client);
+    }
+    for(auto& [id, server] : recovered){
+        if(!server->isManager && server->inFlight == 0)requeueServer(server);
+    }
+    for(auto& [server, process, client] : reconciling){
+        std::thread reconcileThread(reconcileProcess, server, process, client);
+        reconcileThread.detach();
+    }
+}
+
 int main(int argc, char* argv[]) {
-    std::thread initializationThread(ProcessServerInitialization);//thread to allow process servers to connect 
-    std::thread clientThread(clientAccept);//thread to allow clients to connect 
+    uint16_t basePort = 9000;
+    std::string parentAddress;
+    std::string journalPath;
+    std::string ioModel = "threads";
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(arg == "--port" && i + 1 < argc)basePort = std::stoi(argv[++i]);
+        else if(arg == "--parent" && i + 1 < argc)parentAddress = argv[++i];
+        else if(arg == "--journal" && i + 1 < argc)journalPath = argv[++i];
+        else if(arg == "--gso")segmentation = true;
+        else if(arg == "--io" && i + 1 < argc)ioModel = argv[++i];
+        else if(arg == "--max-queued" && i + 1 < argc)maxQueuedJobs = std::stoull(argv[++i]);
+        else if(arg == "--max-client-jobs" && i + 1 < argc)maxClientJobs = std::stoull(argv[++i]);
+        else if(arg == "--peers" && i + 1 < argc){
+            std::istringstream list(argv[++i]);
+            std::string peer;
+            while(std::getline(list, peer, ','))peers.push_back(managerEndPoint(peer));
+        }
+        else{
+            std::cerr << "usage: loadManager [--port <base port>] [--parent <ip>[:<base port>]] [--peers <ip>[:<base port>],...] [--journal <file>] [--max-queued <jobs>] [--max-client-jobs <jobs>] [--gso] [--io threads|epoll|uring]\n";
+            return 1;
+        }
+    }
+    ClientReceivePort = basePort;
+    waitPort = basePort + 1;
+    serverPortStart = basePort + 2;
+    InitializationPort = basePort + 999;
+    Clientsocket.open(boost::asio::ip::udp::v4());
+    Clientsocket.bind({boost::asio::ip::udp::v4(), ClientReceivePort});
+    waitSocket.open(boost::asio::ip::udp::v4());
+    waitSocket.bind({boost::asio::ip::udp::v4(), waitPort});
+    std::thread ackThread(receiveAcks);
+    ackThread.detach();
+    InitializationSocket.open(boost::asio::ip::udp::v4());
+    InitializationSocket.bind({boost::asio::ip::udp::v4(), InitializationPort});
+    if(ioModel != "threads"){//created before recovery so re-adopted batching servers are watched too
+        eventLoop = EventLoop::create(ioModel);
+        if(eventLoop == nullptr)std::cerr << "no event loop for --io " << ioModel << ", using a thread per socket" << std::endl;
+    }
+
+    if(!parentAddress.empty()){//leaf of a tree, jobs arrive in batches from the parent instead of only from clients
+        boost::asio::ip::udp::endpoint parent = managerEndPoint(parentAddress);
+        parentManager = new LoadManager(parent.address().to_string(), parent.port());
+        parentManager->connect();
+        std::thread parentThread(parentReceive);
+        parentThread.detach();
+        std::thread reportThread(capacityReport);
+        reportThread.detach();
+    }
+
+    if(!journalPath.empty()){//replay before accepting anything so recovered jobs keep their place
+        journal = new Journal();
+        std::vector<std::string> records;
+        if(!journal->open(journalPath, records))return 1;
+        recoverJournal(records);
+        std::thread compactionThread(journalCompaction);
+        compactionThread.detach();
+    }
+
+    if(!peers.empty()){//sharded, idle servers move between shards on short leases
+        std::thread watchdogThread(leaseWatchdog);
+        watchdogThread.detach();
+    }
+
+    std::thread drainThread(drainMeter);
+    drainThread.detach();
+
+    if(eventLoop != nullptr)startEventLoop();
+    else{
+        std::thread initializationThread(ProcessServerInitialization);//thread to allow process servers to connect
+        initializationThread.detach();
+        std::thread clientThread(clientAccept);//thread to allow clients to connect
+        clientThread.detach();
+    }
     while (true){
         Client* currentClient = Clients.get();//blocks until a Client is pushed
         processClient(currentClient);
     }
 return 0;
-}
\ No newline at end of file
+}
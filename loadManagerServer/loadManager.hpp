@@ -13,6 +13,7 @@ class Process;
 class ProcessServer;                            
 class LoadManager;                             
 class Client; 
+struct Datagram;
 
 template <typename T>
 class SafeQueue;                                  
@@ -20,6 +21,34 @@ class SafeQueue;
 size_t write_callback(char *contents, size_t size,
 size_t nmemb, std::string *response); // functions
 void ProcessServerInitialization();
-void processClient(Client clinet);
-void processExecutable(std::string path,ProcessServer* server,Client* client);
-void clientAccept();
\ No newline at end of file
+void processClient(Client* client);
+void processExecutable(Process process,ProcessServer* server,Client* client);
+void clientAccept();
+void requeueServer(ProcessServer* server);
+void scheduleClient(Client* client);
+void finishProcess(Client* client, const std::string& output, const Process& process, const std::string& stats = "");
+std::string takeStats(std::string& output);
+void recordUsage(Client* client, const Process& process, const std::string& stats);
+std::string usageReport();
+void cancelJobs(const std::function<bool(Client*)>& owns, const std::function<bool(const Process&)>& match, bool all, const std::string& record);
+void clientCancel(const std::string& message, const boost::asio::ip::udp::endpoint& sender);
+void retireClient(Client* client);
+std::string admit(Client* client);
+void releaseAdmission(const std::string& host, size_t jobs);
+void drainMeter();
+ProcessServer* addServer(uint16_t idCounter, std::string ip, uint16_t processServerPort, const std::string& registration);
+void batchResult(ProcessServer* server, const std::string& id, const std::string& output, const std::string& stats = "");
+std::string takeSlot(std::string& line);
+std::string parseSubmission(Client* client, std::string clientdata);
+void reconcileProcess(ProcessServer* server, Process process, Client* client);
+void journalCompaction();
+void dispatchBatch(ProcessServer* server, Client* client);
+void serverMessage(ProcessServer* server, const std::string& message);
+void subManagerReceive(ProcessServer* server);
+void receiveResults(ProcessServer* server);
+void initializationMessage(const std::string& processServerdata, const boost::asio::ip::udp::endpoint& sender);
+std::vector<Datagram> acceptSubmissions(std::vector<Datagram>& submissions);
+void loopWorker();
+void startEventLoop();
+void parentReceive();
+void capacityReport();
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <iomanip>
+#include <algorithm>
+#include <poll.h>
+#include <sys/resource.h>
+#include <boost/asio.hpp>
+#include "eventLoop.hpp"
+
+//by Robert Britton
+
+// g++ -std=c++20 -O2 -I. -pthread loopBench.cxx eventLoop.cxx -o loopBench
+// ./loopBench [<sockets>] [<rounds>]
+// echoes pings on <sockets> server sockets, like a manager with that many process servers and clients,
+// with a blocking thread per socket (the manager's default), the epoll loop and the io_uring loop,
+// and prints the server's cpu per message along with round trip percentiles
+
+double cpuSeconds(int who){
+    rusage usage;
+    getrusage(who, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+void run(std::string model, size_t count, size_t rounds){
+    boost::asio::io_context io;
+    std::vector<std::unique_ptr<boost::asio::ip::udp::socket>> servers;
+    std::vector<std::unique_ptr<boost::asio::ip::udp::socket>> clients;
+    for(size_t i = 0; i < count; i++){
+        servers.push_back(std::make_unique<boost::asio::ip::udp::socket>(io, boost::asio::ip::udp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0)));
+        clients.push_back(std::make_unique<boost::asio::ip::udp::socket>(io, boost::asio::ip::udp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0)));
+    }
+
+    EventLoop* loop = nullptr;
+    if(model == "threads"){
+        for(auto& server : servers){
+            boost::asio::ip::udp::socket* socket = server.get();
+            std::thread([socket]{
+                std::array<char, 1024> buf;
+                boost::asio::ip::udp::endpoint sender;
+                while(true){
+                    boost::system::error_code error;
+                    size_t n = socket->receive_from(boost::asio::buffer(buf), sender, 0, error);
+                    if(error)return;
+                    socket->send_to(boost::asio::buffer(buf.data(), n), sender, 0, error);
+                }
+            }).detach();
+        }
+    }
+    else{
+        loop = EventLoop::create(model);
+        if(loop == nullptr)return;
+        model = loop->name();
+        for(auto& server : servers){
+            boost::asio::ip::udp::socket* socket = server.get();
+            loop->watch(*socket, [loop, socket](std::vector<Datagram>& datagrams){
+                for(Datagram& datagram : datagrams)loop->send(*socket, std::move(datagram.data), datagram.sender);
+            });
+        }
+        std::thread([loop]{ loop->run(); }).detach();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::vector<double> latencies;
+    std::vector<std::chrono::steady_clock::time_point> sentAt(count);
+    std::vector<pollfd> descriptors(count);
+    for(size_t i = 0; i < count; i++)descriptors[i] = {clients[i]->native_handle(), POLLIN, 0};
+    double processStart = cpuSeconds(RUSAGE_SELF);
+    double clientStart = cpuSeconds(RUSAGE_THREAD);
+    auto start = std::chrono::steady_clock::now();
+    size_t lost = 0;
+    std::array<char, 64> buf;
+    for(size_t round = 0; round < rounds; round++){//every client pings at once, like a burst of results at high client counts
+        for(size_t i = 0; i < count; i++){
+            sentAt[i] = std::chrono::steady_clock::now();
+            clients[i]->send_to(boost::asio::buffer("ping"), servers[i]->local_endpoint());
+        }
+        size_t answered = 0;
+        while(answered < count){
+            if(poll(descriptors.data(), count, 1000) <= 0){
+                lost += count - answered;
+                break;
+            }
+            for(size_t i = 0; i < count; i++){
+                if(!(descriptors[i].revents & POLLIN))continue;
+                clients[i]->receive(boost::asio::buffer(buf));
+                latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sentAt[i]).count());
+                answered++;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double serverCpu = (cpuSeconds(RUSAGE_SELF) - processStart) - (cpuSeconds(RUSAGE_THREAD) - clientStart);
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p){ return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))]; };
+    std::cout << std::left << std::setw(19) << model << std::right
+              << std::setw(9) << (size_t)(latencies.size() / seconds) << " msg/s"
+              << std::setw(8) << std::fixed << std::setprecision(2) << serverCpu * 1e6 / std::max<size_t>(latencies.size(), 1) << " us cpu/msg"
+              << std::setw(9) << std::setprecision(0) << percentile(0.5) << " p50us"
+              << std::setw(9) << percentile(0.99) << " p99us"
+              << std::setw(9) << percentile(0.999) << " p99.9us"
+              << std::setw(6) << lost << " lost" << std::endl;
+    for(auto& server : servers)server->close();//ends the blocking threads, the loop thread is left running
+}
+
+int main(int argc, char* argv[]){
+    size_t sockets = argc > 1 ? std::stoull(argv[1]) : 256;
+    size_t rounds = argc > 2 ? std::stoull(argv[2]) : 200;
+    for(std::string model : {"threads", "epoll", "uring"})run(model, sockets, rounds);
+    return 0;
+}
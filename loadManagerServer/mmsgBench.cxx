@@ -0,0 +1,82 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <iomanip>
+#include <sys/resource.h>
+#include <boost/asio.hpp>
+#include "batchSocket.hpp"
+
+//by Robert Britton
+
+// g++ -std=c++20 -O2 -I. -pthread mmsgBench.cxx batchSocket.cxx -o mmsgBench
+// ./mmsgBench [<datagrams>] [<bytes per datagram>]
+// sends datagrams over loopback with sendto/recvfrom, sendmmsg/recvmmsg and sendmmsg/recvmmsg with UDP segmentation
+// and prints datagrams/sec along with datagrams per cpu second, the number that matters when the manager shares a core
+
+boost::asio::io_context io;
+
+double cpuSeconds(){
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+void run(std::string mode, size_t datagrams, size_t bytes){
+    boost::asio::ip::udp::socket receiver(io, {boost::asio::ip::make_address("127.0.0.1"), 0});
+    boost::asio::ip::udp::socket sender(io, {boost::asio::ip::make_address("127.0.0.1"), 0});
+    receiver.set_option(boost::asio::socket_base::receive_buffer_size(8 << 20));
+    sender.set_option(boost::asio::socket_base::send_buffer_size(8 << 20));
+    boost::asio::ip::udp::endpoint destination = receiver.local_endpoint();
+    bool segmentation = mode == "gso";
+    BatchSocket batchReceiver(receiver, 64, 65536, segmentation);
+    BatchSocket batchSender(sender, 64, bytes, segmentation);
+    std::string message(bytes, 'x');
+
+    std::atomic<size_t> received = 0;
+    double cpuStart = cpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+    std::thread receiveThread([&]{
+        std::vector<char> buf(65536);
+        boost::asio::ip::udp::endpoint from;
+        while(received < datagrams){
+            if(mode == "single"){
+                pollfd descriptor = {receiver.native_handle(), POLLIN, 0};
+                if(poll(&descriptor, 1, 200) <= 0)break;
+                receiver.receive_from(boost::asio::buffer(buf), from);
+                received++;
+            }
+            else{
+                size_t n = batchReceiver.receive(200);
+                if(n == 0)break;//whatever is missing was dropped
+                received += n;
+            }
+        }
+    });
+    size_t calls = 0;
+    for(size_t sent = 0; sent < datagrams;){
+        if(mode == "single"){
+            sender.send_to(boost::asio::buffer(message), destination);
+            sent++;
+            calls++;
+        }
+        else{
+            for(size_t i = 0; i < 64 && sent < datagrams; i++, sent++)batchSender.queue(message, destination);
+            calls += batchSender.flush();
+        }
+        if(sent % 4096 == 0)std::this_thread::yield();//lets the receiver drain so loopback does not drop
+    }
+    receiveThread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = cpuSeconds() - cpuStart;
+    std::cout << std::left << std::setw(8) << (segmentation && !batchSender.segmenting() ? "gso(off)" : mode)
+              << std::right << std::setw(10) << received << " received" << std::setw(12) << (size_t)(received / seconds) << " dgram/s"
+              << std::setw(12) << (size_t)(received / std::max(cpu, 1e-6)) << " dgram/cpu-s" << std::setw(10) << calls << " send calls" << std::endl;
+}
+
+int main(int argc, char* argv[]){
+    size_t datagrams = argc > 1 ? std::stoull(argv[1]) : 200000;
+    size_t bytes = argc > 2 ? std::stoull(argv[2]) : 64;
+    for(std::string mode : {"single", "mmsg", "gso"})run(mode, datagrams, bytes);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <iomanip>
+#include <algorithm>
+#include <sys/resource.h>
+#include "runEXE/runEXE.hpp"
+#include "runEXE/zygote.hpp"
+
+//by Robert Britton
+
+// g++ -std=c++20 -O2 -pthread launchBench.cxx runEXE/runEXE.cxx runEXE/zygote.cxx -o launchBench
+// ./launchBench [<jobs>] [<server MB>] [<burst>]
+// starts <jobs> empty jobs from a process holding <server MB> of touched memory, like a busy processServer,
+// once by forking it and once through the launch helper, one at a time and <burst> at once,
+// and prints launch to exit latency, the server's cpu and page faults per job, and the largest RSS any job reached
+
+struct Sample{
+    double cpu;
+    long minflt;
+};
+
+Sample self(){
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return {usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6, usage.ru_minflt};
+}
+
+void run(std::string mode, Zygote* zygote, size_t jobs, size_t burst){
+    useZygote(mode == "zygote" ? zygote : nullptr);
+    std::vector<double> latencies(jobs);
+    std::vector<long> peaks(jobs);
+    Sample before = self();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < burst; t++){
+        threads.emplace_back([&, t]{
+            for(size_t i = t; i < jobs; i += burst){
+                auto launched = std::chrono::steady_clock::now();
+                RunResult result = runCommand("true", RunLimits());
+                latencies[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - launched).count();
+                peaks[i] = result.usage.ru_maxrss;
+            }
+        });
+    }
+    for(std::thread& thread : threads)thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Sample after = self();
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p){ return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))]; };
+    std::cout << std::left << std::setw(7) << mode << std::right << std::setw(4) << burst << " at once"
+              << std::setw(8) << (size_t)(jobs / seconds) << " jobs/s"
+              << std::setw(8) << std::fixed << std::setprecision(0) << percentile(0.5) << " p50us"
+              << std::setw(8) << percentile(0.99) << " p99us"
+              << std::setw(8) << (after.cpu - before.cpu) * 1e6 / jobs << " us cpu/job"
+              << std::setw(7) << (double)(after.minflt - before.minflt) / jobs << " faults/job"
+              << std::setw(8) << *std::max_element(peaks.begin(), peaks.end()) / 1024 << " MB job peak rss" << std::endl;
+}
+
+int main(int argc, char* argv[]){
+    size_t jobs = argc > 1 ? std::stoull(argv[1]) : 2000;
+    size_t megabytes = argc > 2 ? std::stoull(argv[2]) : 512;
+    size_t burst = argc > 3 ? std::stoull(argv[3]) : 16;
+    Zygote* zygote = Zygote::start();//before the memory below exists, as the processServer does it
+    if(zygote == nullptr)std::cerr << "launch helper failed to start, both runs fork" << std::endl;
+    std::vector<char> server(megabytes << 20);
+    for(size_t i = 0; i < server.size(); i += 4096)server[i] = 1;
+    for(size_t concurrency : {(size_t)1, burst}){
+        run("fork", zygote, jobs, concurrency);
+        run("zygote", zygote, jobs, concurrency);
+    }
+    return 0;
+}
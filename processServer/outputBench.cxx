@@ -0,0 +1,81 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <iomanip>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <boost/asio.hpp>
+#include "runEXE/runEXE.hpp"
+
+//by Robert Britton
+
+// g++ -std=c++20 -O2 -I. -pthread outputBench.cxx runEXE/runEXE.cxx runEXE/zygote.cxx -o outputBench
+// ./outputBench [<MB per job>] [<jobs>]
+// runs jobs that write <MB per job> to standard output and sends each one's result datagram over loopback,
+// once reading the output into strings as the processServer used to and once spliced into a memfd and sent from its pages,
+// and prints output bytes/sec, the server's cpu per GB of output and its peak RSS (job cpu is not counted)
+
+constexpr size_t maxDatagram = 65536;
+
+double cpuSeconds(){
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+long peakRSS(){
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void run(const std::string& mode, size_t megabytes, size_t jobs, boost::asio::ip::udp::socket& sock, const boost::asio::ip::udp::endpoint& sink){
+    std::string command = "head -c " + std::to_string(megabytes << 20) + " /dev/zero";
+    RunLimits limits;
+    limits.spool = mode == "splice";
+    limits.keep = maxDatagram;
+    double cpuStart = cpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < jobs; i++){
+        RunResult result = runCommand(command, limits);
+        if(mode == "read"){//the copies the old exeCMD and addResult made
+            std::string output = command + ":\n" + result.output;
+            if(output.size() > maxDatagram / 2)output.resize(maxDatagram / 2);
+            std::string results = "RESULTS 1\n" + std::to_string(i) + "\t" + std::to_string(output.size()) + "\t0\t\n";
+            results += output;
+            sock.send_to(boost::asio::buffer(results), sink);
+        }
+        else{
+            std::string head = command + ":\n";
+            std::string line = "RESULTS 1\n" + std::to_string(i) + "\t" + std::to_string(maxDatagram / 2) + "\t0\t\n";
+            size_t text = std::min(result.output.size(), maxDatagram / 2 - head.size());
+            size_t spooled = std::min(result.spool ? result.spool->size() : 0, maxDatagram / 2 - head.size() - text);
+            iovec vectors[4] = {{line.data(), line.size()}, {head.data(), head.size()}, {result.output.data(), text},
+                                {(void*)(result.spool ? result.spool->data().data() : nullptr), spooled}};
+            msghdr header = {};
+            header.msg_name = (void*)sink.data();
+            header.msg_namelen = sink.size();
+            header.msg_iov = vectors;
+            header.msg_iovlen = 4;
+            sendmsg(sock.native_handle(), &header, 0);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double gigabytes = (double)(megabytes * jobs) / 1024;
+    std::cout << std::left << std::setw(8) << mode << std::right << std::fixed << std::setprecision(0)
+              << std::setw(8) << megabytes * jobs / seconds << " MB/s"
+              << std::setw(9) << std::setprecision(3) << (cpuSeconds() - cpuStart) / gigabytes << " server cpu s/GB"
+              << std::setw(9) << peakRSS() / 1024 << " MB peak rss" << std::endl;
+}
+
+int main(int argc, char* argv[]){
+    size_t megabytes = argc > 1 ? std::stoull(argv[1]) : 256;
+    size_t jobs = argc > 2 ? std::stoull(argv[2]) : 8;
+    boost::asio::io_context io;
+    boost::asio::ip::udp::socket sock(io, {boost::asio::ip::make_address("127.0.0.1"), 0});
+    boost::asio::ip::udp::socket sink(io, {boost::asio::ip::make_address("127.0.0.1"), 0});
+    run("splice", megabytes, jobs, sock, sink.local_endpoint());//first, since peak RSS only goes up
+    run("read", megabytes, jobs, sock, sink.local_endpoint());
+    return 0;
+}
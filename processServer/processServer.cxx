@@ -5,17 +5,36 @@
 #include <boost/asio.hpp>
 #include <chrono>
 #include <atomic>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
+#include <sstream>
+#include <condition_variable>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "fileCompression/compression.hpp"
+#include "runEXE/runEXE.hpp"
+#include "runEXE/zygote.hpp"
+#include "slots/slots.hpp"
 
 //By Robert Britton
 
-extern std::string runCommandAndGetOutput(std::string command);
-
 std::atomic<bool> timeOut = true;
 
 uint16_t  serverPort = 9999;
 uint16_t receivePort = 9998;
-// g++ -std=c++20 -I. -pthread processServer.cxx -lcurl -o processServer
+constexpr size_t maxDatagram = 65536;
+constexpr auto linger = std::chrono::milliseconds(2);//longest a finished result waits for others to share its datagram
+RunLimits limits;//applied to every job, a hung executable is killed instead of holding the server forever
+Slots* slots = nullptr;//set with --pin, jobs then run one per core slot at once and are pinned to it
+std::string memoryPolicy;//"preferred" or "bind" keeps a pinned job's memory on its slot's node
+// g++ -std=c++20 -I. -I.. -pthread processServer.cxx runEXE/runEXE.cxx runEXE/zygote.cxx slots/slots.cxx ../fileCompression/compression.cpp ../fileCompression/huffman.cpp ../fileCompression/histogram.cpp ../fileCompression/encryption.cpp ../fileCompression/lz77.cpp -lcurl -o processServer
+// ./processServer <load manager ip> [<load manager base port>] [--no-batch] [--no-zygote] [--pin] [--mempolicy preferred|bind] [--wall-limit <seconds>] [--cpu-limit <seconds>] [--kill-grace <ms>]
 
 boost::asio::io_context io;
 
@@ -38,16 +57,239 @@ boost::asio::ip::udp::socket findOpenPort(uint16_t port) {
 
 
 
-std::string exeCMD(std::string cmd){//will run external command place holder
-<<<<<<< Updated upstream
-    // std::string fileName = decompressFile(cmd);
-=======
-    
->>>>>>> Stashed changes
-    return cmd + ":\n" + runCommandAndGetOutput(cmd);
+std::string statsText(const RunResult& result){//key=value pairs without spaces, aggregated by the manager
+    const rusage& usage = result.usage;
+    long maxRSS = usage.ru_maxrss;//kilobytes on Linux
+#ifdef __APPLE__
+    maxRSS /= 1024;//bytes on macOS
+#endif
+    std::string stats = "user=" + std::to_string(usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6) +
+        ",sys=" + std::to_string(usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6) +
+        ",rss=" + std::to_string(maxRSS) + ",minflt=" + std::to_string(usage.ru_minflt) + ",majflt=" + std::to_string(usage.ru_majflt) +
+        ",nvcsw=" + std::to_string(usage.ru_nvcsw) + ",nivcsw=" + std::to_string(usage.ru_nivcsw);
+    if(result.cycles >= 0)stats += ",cycles=" + std::to_string(result.cycles);
+    if(result.instructions >= 0)stats += ",instructions=" + std::to_string(result.instructions);
+    return stats;
+}
+
+std::string takeSlot(std::string& command){//strips SLOT <request> from the front of a command and returns the request
+    if(command.rfind("SLOT ", 0) != 0)return "";
+    size_t end = command.find(' ', 5);
+    std::string request = command.substr(5, end == std::string::npos ? std::string::npos : end - 5);
+    command = end == std::string::npos ? "" : command.substr(end + 1);
+    return request;
+}
+
+struct JobOutput{//"<cmd>:\n", the job's output and why it was stopped, sent without gathering them into one string
+    std::string head;
+    std::string text;//output read before any spool
+    std::shared_ptr<Spool> spool;//the rest of a large output, sent straight from the memfd's pages
+    size_t spooled = 0;//bytes of the spool that are sent
+    std::string note;//why the job was stopped
+
+    size_t size() const{ return head.size() + text.size() + spooled + note.size(); }
+
+    void truncate(size_t limit){
+        head.resize(std::min(head.size(), limit));
+        text.resize(std::min(text.size(), limit - head.size()));
+        spooled = std::min(spooled, limit - head.size() - text.size());
+        note.resize(std::min(note.size(), limit - head.size() - text.size() - spooled));
+    }
+
+    void buffers(std::vector<boost::asio::const_buffer>& sequence) const{
+        sequence.push_back(boost::asio::buffer(head));
+        sequence.push_back(boost::asio::buffer(text));
+        if(spooled > 0)sequence.push_back(boost::asio::buffer(spool->data().data(), spooled));
+        sequence.push_back(boost::asio::buffer(note));
+    }
+};
+
+void sendGathered(boost::asio::ip::udp::socket& sock, const std::vector<boost::asio::const_buffer>& datagram, const boost::asio::ip::udp::endpoint& destination){
+    std::vector<iovec> vectors;//asio hands at most 64 buffers of a sequence to the kernel, a full batch has more
+    for(const boost::asio::const_buffer& buffer : datagram){
+        if(buffer.size() > 0)vectors.push_back({(void*)buffer.data(), buffer.size()});
+    }
+    msghdr header = {};
+    header.msg_name = (void*)destination.data();
+    header.msg_namelen = destination.size();
+    header.msg_iov = vectors.data();
+    header.msg_iovlen = vectors.size();
+    if(sendmsg(sock.native_handle(), &header, 0) < 0)std::cerr << "Failed to send a result: " << strerror(errno) << std::endl;
+}
+
+bool compressedProgram(const std::string& command){//the program is a .cmp from the fileCompressor
+    std::string program = command.substr(0, command.find_first_of(" \t"));
+    return program.size() > 4 && program.compare(program.size() - 4, 4, ".cmp") == 0;
+}
+
+int unpackExecutable(std::string& command){//decompresses the .cmp program into a memfd and takes .cmp off its name, -1 if it can not
+#ifdef __linux__
+    std::string program = command.substr(0, command.find_first_of(" \t"));
+    int fd = memfd_create("job executable", MFD_CLOEXEC);
+    if(fd < 0)return -1;
+    if(!decompressFile(program, descriptorSink(fd), 1)){//jobs already run one per slot, so one thread each
+        close(fd);
+        return -1;
+    }
+    command.erase(program.size() - 4, 4);//argv[0] of the job
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+JobOutput exeCMD(std::string cmd, RunControl* control, std::string& stats){//will run external command place holder
+    std::string request = takeSlot(cmd);
+    int executable = -1;
+    if(compressedProgram(cmd)){//run straight from memory, nothing is written to the filesystem
+        executable = unpackExecutable(cmd);
+        if(executable < 0)return {cmd + ":\n", "", nullptr, 0, "[stopped: could not decompress]\n"};
+    }
+    RunLimits jobLimits = limits;
+    Placement placement;
+    if(slots != nullptr){
+        placement = slots->acquire(request);
+        jobLimits.cpus = placement.cpus;
+        if(!memoryPolicy.empty())jobLimits.memoryNode = placement.node;
+        jobLimits.bindMemory = memoryPolicy == "bind";
+    }
+    RunResult result = runCommand(cmd, jobLimits, control, executable);
+    if(executable >= 0)close(executable);
+    if(slots != nullptr)slots->release(placement);
+    stats = statsText(result);
+    return {cmd + ":\n", std::move(result.output), result.spool, result.spool ? result.spool->size() : 0, result.stopped.empty() ? "" : "[stopped: " + result.stopped + "]\n"};
+}
+
+
+
+struct BatchJob{
+    std::string id;
+    std::string command;
+    boost::asio::ip::udp::endpoint manager;//the socket the BATCH came from, its result goes back there even if another manager sends batches meanwhile
+};
+
+std::deque<BatchJob> batchJobs;//every job received in a BATCH and not run yet
+std::unordered_map<RunControl*, std::string> running;//jobs being run, batched or not, by id so a CANCEL can stop them, the id is empty without a BATCH
+std::mutex jobs_mtx;
+std::condition_variable jobsCv;
+
+struct PendingResults{//finished results for one manager not sent yet, each with its RESULTS line
+    std::vector<std::pair<std::string, JobOutput>> results;
+    size_t bytes = 0;
+    std::chrono::steady_clock::time_point first;
+};
+std::map<boost::asio::ip::udp::endpoint, PendingResults> pendingResults;
+std::mutex results_mtx;
+std::condition_variable resultsCv;
+
+void flushResults(boost::asio::ip::udp::socket& sock, const boost::asio::ip::udp::endpoint& manager){//called with results_mtx held
+    auto pending = pendingResults.find(manager);
+    if(pending == pendingResults.end())return;
+    std::string header = "RESULTS " + std::to_string(pending->second.results.size()) + "\n";
+    std::vector<boost::asio::const_buffer> datagram{boost::asio::buffer(header)};//one sendmsg gathers every piece
+    for(auto& [line, output] : pending->second.results){
+        datagram.push_back(boost::asio::buffer(line));
+        output.buffers(datagram);
+    }
+    sendGathered(sock, datagram, manager);
+    pendingResults.erase(pending);
+}
+
+void addResult(boost::asio::ip::udp::socket& sock, const boost::asio::ip::udp::endpoint& manager, const std::string& id, JobOutput output, long long microseconds, const std::string& stats, bool idle){
+    output.truncate(maxDatagram / 2);
+    std::string line = id + '\t' + std::to_string(output.size()) + '\t' + std::to_string(microseconds) + '\t' + stats + '\n';
+    auto finish = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(results_mtx);
+    auto pending = pendingResults.find(manager);
+    if(pending != pendingResults.end() && pending->second.bytes + line.size() + output.size() + 64 > maxDatagram)flushResults(sock, manager);
+    PendingResults& batch = pendingResults[manager];
+    if(batch.results.empty())batch.first = finish;
+    batch.bytes += line.size() + output.size();
+    batch.results.push_back({std::move(line), std::move(output)});
+    if(idle || finish - batch.first >= linger)flushResults(sock, manager);//nothing else is coming soon, so there is no reason to wait
+    else resultsCv.notify_one();
+}
+
+void runBatches(boost::asio::ip::udp::socket& sock){//runs batched jobs one at a time and coalesces their results, one of these runs per slot
+    while(true){
+        BatchJob job;
+        RunControl control;
+        {
+            std::unique_lock<std::mutex> lock(jobs_mtx);
+            jobsCv.wait(lock, []{ return !batchJobs.empty(); });
+            job = batchJobs.front();
+            batchJobs.pop_front();
+            running[&control] = job.id;
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::string stats;
+        JobOutput output = exeCMD(job.command, &control, stats);
+        auto finish = std::chrono::steady_clock::now();
+        bool idle;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mtx);
+            running.erase(&control);
+            idle = batchJobs.empty() && running.empty();
+        }
+        addResult(sock, job.manager, job.id, output, std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count(), stats, idle);
+    }
+}
+
+void cancelJobs(boost::asio::ip::udp::socket& sock, const std::string& message){//CANCEL <id> <id>... for batched jobs, a bare CANCEL stops the job being run
+    std::istringstream fields(message.substr(6));
+    std::vector<std::string> ids;
+    std::string id;
+    while(fields >> id)ids.push_back(id);
+    std::vector<BatchJob> dropped;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mtx);
+        for(auto& [control, runningID] : running){
+            if(ids.empty() || std::find(ids.begin(), ids.end(), runningID) != ids.end())cancelRun(*control);
+        }
+        for(const std::string& cancelID : ids){
+            auto job = std::find_if(batchJobs.begin(), batchJobs.end(), [&](auto& queued){ return queued.id == cancelID; });
+            if(job == batchJobs.end())continue;//already finished
+            dropped.push_back(*job);
+            batchJobs.erase(job);
+        }
+    }
+    for(BatchJob& job : dropped)addResult(sock, job.manager, job.id, {job.command + ":\n", "", nullptr, 0, "[stopped: cancelled]\n"}, 0, "", true);//the manager still frees the slot from a result
 }
 
+void runSingle(boost::asio::ip::udp::socket& sock, std::string command, boost::asio::ip::udp::endpoint sender){//a job from the manager without a BATCH, run off the receive thread so a CANCEL can reach it
+    RunControl control;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mtx);
+        running[&control] = "";
+    }
+    std::string stats;
+    JobOutput output = exeCMD(command, &control, stats);
+    {
+        std::lock_guard<std::mutex> lock(jobs_mtx);
+        running.erase(&control);
+    }
+    std::string header = "STATS " + stats + "\n";//the manager takes the first line off before the client sees it
+    output.truncate(maxDatagram - 1024);//a UDP datagram can not carry more
+    std::vector<boost::asio::const_buffer> datagram{boost::asio::buffer(header)};
+    output.buffers(datagram);
+    sendGathered(sock, datagram, sender);
+}
 
+void lingerFlush(boost::asio::ip::udp::socket& sock){//sends held results if the job after them runs past the linger time
+    std::unique_lock<std::mutex> lock(results_mtx);
+    while(true){
+        resultsCv.wait(lock, []{ return !pendingResults.empty(); });
+        auto oldest = std::chrono::steady_clock::time_point::max();
+        for(auto& [manager, pending] : pendingResults)oldest = std::min(oldest, pending.first);
+        resultsCv.wait_until(lock, oldest + linger);//a new result wakes it early, the deadlines are looked at again
+        auto now = std::chrono::steady_clock::now();
+        std::vector<boost::asio::ip::udp::endpoint> due;
+        for(auto& [manager, pending] : pendingResults){
+            if(now - pending.first >= linger)due.push_back(manager);
+        }
+        for(auto& manager : due)flushResults(sock, manager);
+    }
+}
 
 void TimeOutTimer(){
     std::this_thread::sleep_for(std::chrono::seconds(5));
@@ -59,9 +301,35 @@ void TimeOutTimer(){
 
 int main(int argc, char* argv[])
 {
-    if(argc < 2) { std::cerr << "usage: peer_a <peer‑ip>\n"; return 1; }
-    
-    std::string initMessage ="init";
+    std::string initMessage ="batch";//"init" registers a server that only takes one job per message
+    bool launchHelper = true;
+    std::vector<std::string> positional;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(arg == "--no-batch")initMessage = "init";
+        else if(arg == "--no-zygote")launchHelper = false;
+        else if(arg == "--pin")slots = new Slots();
+        else if(arg == "--mempolicy" && i + 1 < argc)memoryPolicy = argv[++i];
+        else if(arg == "--wall-limit" && i + 1 < argc)limits.wallSeconds = std::stod(argv[++i]);
+        else if(arg == "--cpu-limit" && i + 1 < argc)limits.cpuSeconds = std::stod(argv[++i]);
+        else if(arg == "--kill-grace" && i + 1 < argc)limits.grace = std::chrono::milliseconds(std::stoll(argv[++i]));
+        else positional.push_back(arg);
+    }
+    if(positional.empty()) { std::cerr << "usage: peer_a <peer‑ip> [<manager base port>] [--no-batch] [--no-zygote] [--pin] [--mempolicy preferred|bind] [--wall-limit <seconds>] [--cpu-limit <seconds>] [--kill-grace <ms>]\n"; return 1; }
+    if(launchHelper){//forked before any socket or thread exists, so the helper starting the jobs stays small
+        Zygote* zygote = Zygote::start();
+        useZygote(zygote);
+        if(zygote == nullptr)std::cerr << "Launch helper failed to start, jobs are forked from the server" << std::endl;
+    }
+    limits.counters = countersAvailable();
+    limits.spool = true;//only what fits in a datagram is kept, the rest never enters the process
+    limits.keep = maxDatagram;
+    std::cout << "Hardware counters: " << (limits.counters ? "cycles and instructions" : "not available") << std::endl;
+    if(slots != nullptr){//the manager sizes batches from the core count and a job can ask for whole cores or nodes
+        initMessage += " " + slots->describe();
+        std::cout << "Pinning jobs to slots: " << slots->describe() << std::endl;
+    }
+    if(positional.size() > 1) serverPort = std::stoi(positional[1]) + 999;//managers sharing a host each listen for process servers at base port + 999
 
     boost::asio::ip::udp::socket sock = findOpenPort(receivePort);
 
@@ -69,8 +337,8 @@ int main(int argc, char* argv[])
     boost::asio::io_context io;
     
 
-    std::array<char, 1024> buf;
-    boost::asio::ip::udp::endpoint initServer(boost::asio::ip::make_address(argv[1]), serverPort);
+    std::vector<char> buf(maxDatagram);
+    boost::asio::ip::udp::endpoint initServer(boost::asio::ip::make_address(positional[0]), serverPort);
 
 
     sock.send_to(boost::asio::buffer(initMessage), initServer);//send initialization message to load manager server
@@ -79,21 +347,45 @@ int main(int argc, char* argv[])
 
     sock.receive_from(boost::asio::buffer(buf), initServer);
     std::cout<<"IP: " << sock.local_endpoint().address() << " Port: " << sock.local_endpoint().port() << "\n";
-    std::cout <<"Server IP: "<< argv[1] << " Server Port: " << initServer.port() << std::endl;
+    std::cout <<"Server IP: "<< positional[0] << " Server Port: " << initServer.port() << std::endl;
     timeOut.store(false);//stops timeout 
 
 
-    boost::asio::ip::udp::endpoint sender(boost::asio::ip::make_address(argv[1]), initServer.port());
+    boost::asio::ip::udp::endpoint sender(boost::asio::ip::make_address(positional[0]), initServer.port());
 
 
 
+    for(size_t i = 0; i < (slots != nullptr ? slots->cores() : 1); i++){
+        std::thread batchThread(runBatches, std::ref(sock));
+        batchThread.detach();
+    }
+    std::thread lingerThread(lingerFlush, std::ref(sock));
+    lingerThread.detach();
+
     for (;;){
         auto n = sock.receive_from(boost::asio::buffer(buf), sender);
-
-
+        std::string message = std::string(std::string_view(buf.data(), n));
+
+        if(message.rfind("BATCH ", 0) == 0){//BATCH <count>\n<id>\t<command>\n...
+            std::istringstream lines(message.substr(message.find('\n') + 1));
+            std::string line;
+            std::lock_guard<std::mutex> lock(jobs_mtx);
+            while(std::getline(lines, line)){
+                if(line.find('\t') == std::string::npos)continue;
+                batchJobs.push_back({line.substr(0, line.find('\t')), line.substr(line.find('\t') + 1), sender});
+            }
+            jobsCv.notify_all();//a batch can fill every slot, so every idle worker is woken
+            continue;
+        }
         
-        std::cout << "\n<managerServer> " << std::string_view(buf.data(), n) << '\n';
-        sock.send_to(boost::asio::buffer(exeCMD(std::string(std::string_view(buf.data(), n)))), sender);
+        if(message.rfind("CANCEL", 0) == 0){
+            cancelJobs(sock, message);
+            continue;
+        }
+
+        std::cout << "\n<managerServer> " << message << '\n';
+        std::thread singleThread(runSingle, std::ref(sock), message, sender);
+        singleThread.detach();
 
     }
 
@@ -1,24 +1,285 @@
-
 #include <iostream>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sched.h>
+#include <linux/perf_event.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
 #include "runEXE.hpp"
+#include "zygote.hpp"
+
+extern char** environ;
+
+#ifdef __linux__
+int openCounter(pid_t pid, uint64_t config, bool fromExec = true){//counts the process and everything it starts, from its exec on, in user space
+    perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = fromExec;
+    attr.enable_on_exec = fromExec;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+long long readCounter(int fd){
+    long long count = -1;
+    if(fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count))count = -1;
+    if(fd >= 0)close(fd);
+    return count;
+}
+#endif
+
+bool countersAvailable(){
+#ifdef __linux__
+    int fd = openCounter(0, PERF_COUNT_HW_INSTRUCTIONS);
+    if(fd < 0)return false;
+    close(fd);
+    return true;
+#else
+    return false;
+#endif
+}
 
 std::string runCommandAndGetOutput(std::string command) {
-    std::string output;
-    FILE* pipe = popen(command.c_str(), "r");
-    if (!pipe) {
-        std::cerr << "Failed to execute the following command : " << command << std::endl;
-        return "";
+    return runCommand(command, RunLimits()).output;
+}
+
+void placeProcess(const RunLimits& limits){//only stack memory and system calls, it runs between fork and exec
+#ifdef __linux__
+    if(!limits.cpus.empty()){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(int cpu : limits.cpus){
+            if(cpu < CPU_SETSIZE)CPU_SET(cpu, &set);
+        }
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+    if(limits.memoryNode >= 0 && limits.memoryNode < 64){
+        unsigned long mask = 1UL << limits.memoryNode;
+        syscall(SYS_set_mempolicy, limits.bindMemory ? MPOL_BIND : MPOL_PREFERRED, &mask, 64);
+    }
+#endif
+}
+
+Spool::Spool(int fd, size_t size): fd(fd), length(size) {
+    if(length > 0){
+        void* pages = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if(pages == MAP_FAILED)length = 0;
+        else mapped = (char*)pages;
+    }
+}
+
+Spool::~Spool(){
+    if(mapped != nullptr)munmap(mapped, length);
+    close(fd);
+}
+
+Zygote* launcher = nullptr;
+constexpr size_t spoolAfter = 16384;//output up to here is read as usual, splicing only pays off past it
+
+void useZygote(Zygote* zygote){
+    launcher = zygote;
+}
+
+int openPidfd(pid_t pid){
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    return -1;
+#endif
+}
+
+void cancelRun(RunControl& control){
+    control.cancelled = true;
+    pid_t group = control.group.load();
+    if(group > 0)kill(-group, SIGTERM);//the run itself sends SIGKILL if the group outlives the grace time
+}
+
+std::vector<std::string> splitWords(const std::string& command){
+    std::vector<std::string> words;
+    size_t start = command.find_first_not_of(" \t");
+    while(start != std::string::npos){
+        size_t end = command.find_first_of(" \t", start);
+        words.push_back(command.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        start = command.find_first_not_of(" \t", end);
     }
+    return words;
+}
 
-    char buffer[128];
-    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-        output += buffer;
+std::string forkCommand(const std::string& command, const RunLimits& limits, int executable, Launch& launched, int& cycleCounter, int& instructionCounter){//empty on success, otherwise why it failed
+    std::vector<std::string> words = executable >= 0 ? splitWords(command) : std::vector<std::string>();//made before the fork, the child only makes system calls
+    std::vector<char*> arguments;
+    for(std::string& word : words)arguments.push_back(word.data());
+    arguments.push_back(nullptr);
+    int pipeFds[2];
+    int startFds[2] = {-1, -1};//holds the child before exec until its counters are attached
+    if(limits.counters && pipe(startFds) != 0)startFds[0] = startFds[1] = -1;
+    if(pipe(pipeFds) != 0){
+        if(startFds[0] >= 0){
+            close(startFds[0]);
+            close(startFds[1]);
+        }
+        return "no pipe";
+    }
+    pid_t pid = fork();
+    if(pid < 0){
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        if(startFds[0] >= 0){
+            close(startFds[0]);
+            close(startFds[1]);
+        }
+        return "fork failed";
+    }
+    if(pid == 0){
+        setpgid(0, 0);
+        dup2(pipeFds[1], STDOUT_FILENO);
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        if(limits.cpuSeconds > 0){//SIGXCPU at the soft limit, SIGKILL a second later if it is caught
+            rlim_t seconds = (rlim_t)std::ceil(limits.cpuSeconds);
+            rlimit cpu = {seconds, seconds + 1};
+            setrlimit(RLIMIT_CPU, &cpu);
+        }
+        placeProcess(limits);
+        if(startFds[0] >= 0){
+            char go;
+            close(startFds[1]);
+            while(read(startFds[0], &go, 1) < 0 && errno == EINTR);
+            close(startFds[0]);
+        }
+#ifdef __linux__
+        if(executable >= 0)fexecve(executable, arguments.data(), environ);//an ELF runs from a close on exec fd, the kernel has it open by then
+        else
+#endif
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+        _exit(127);
     }
+    setpgid(pid, pid);//also done here so a cancel right after fork can not miss the group
+    close(pipeFds[1]);
+    if(startFds[0] >= 0){
+#ifdef __linux__
+        cycleCounter = openCounter(pid, PERF_COUNT_HW_CPU_CYCLES);
+        instructionCounter = openCounter(pid, PERF_COUNT_HW_INSTRUCTIONS);
+#endif
+        close(startFds[0]);
+        close(startFds[1]);//the child reads end of file and goes on to exec
+    }
+    launched = {pid, pipeFds[0], openPidfd(pid)};
+    if(launched.pidfd >= 0)fcntl(launched.pidfd, F_SETFD, FD_CLOEXEC);
+    return "";
+}
 
-    auto returnCode = pclose(pipe);
-    // if (returnCode != 0) {
-    //     std::cerr << "Command retunred an error: " << returnCode << std::endl;
-    // }
+RunResult runCommand(const std::string& command, const RunLimits& limits, RunControl* control, int executable) {
+    RunResult result;
+    Launch launched;
+    int cycleCounter = -1;
+    int instructionCounter = -1;
+    bool spawned = launcher != nullptr && executable < 0 && launcher->launch(command, limits, launched);
+    if(spawned){
+#ifdef __linux__
+        if(limits.counters){//attached once the helper has spawned it, so the first few instructions of the shell are missed
+            cycleCounter = openCounter(launched.pid, PERF_COUNT_HW_CPU_CYCLES, false);
+            instructionCounter = openCounter(launched.pid, PERF_COUNT_HW_INSTRUCTIONS, false);
+        }
+#endif
+    }
+    else{
+        result.stopped = forkCommand(command, limits, executable, launched, cycleCounter, instructionCounter);
+        if(!result.stopped.empty()){
+            std::cerr << "Failed to execute the following command : " << command << std::endl;
+            return result;
+        }
+    }
+    pid_t pid = launched.pid;
+    if(control != nullptr){
+        control->group = pid;
+        if(control->cancelled)kill(-pid, SIGTERM);
+    }
+    auto reap = [&](int milliseconds){
+        if(spawned)return launcher->exited(pid, result.status, result.usage, milliseconds);
+        return wait4(pid, &result.status, WNOHANG, &result.usage) == pid;
+    };
 
-    return output;
-}
\ No newline at end of file
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point terminated;
+    bool reading = true;
+    bool exited = false;
+    char buffer[4096];
+    int spoolFd = -1;
+    int discard = -1;
+#ifdef __linux__
+    loff_t spooled = 0;
+    bool splicing = limits.spool;//until a splice fails
+#endif
+    while(reading || !exited){
+        auto now = std::chrono::steady_clock::now();
+        if(result.stopped.empty()){
+            if(control != nullptr && control->cancelled)result.stopped = "cancelled";
+            else if(limits.wallSeconds > 0 && now - start >= std::chrono::duration<double>(limits.wallSeconds))result.stopped = "wall clock limit";
+            if(!result.stopped.empty()){
+                kill(-pid, SIGTERM);
+                terminated = now;
+            }
+        }
+        else if(now - terminated >= limits.grace)kill(-pid, SIGKILL);//repeated until the group is gone, it is cheap
+        if(!exited)exited = reap(0);
+        if(exited && (!result.stopped.empty() || !reading))break;//whatever the group left behind is killed below, not waited for
+        pollfd descriptors[2] = {{reading ? launched.output : -1, POLLIN, 0}, {exited ? -1 : launched.pidfd, POLLIN, 0}};
+        int timeout = reading || launched.pidfd >= 0 ? 20 : 1;//the limits are checked at least every 20ms, the exit is waited for on the pidfd when there is one
+        poll(descriptors, 2, timeout);
+        bool spliced = false;
+#ifdef __linux__
+        if(descriptors[0].revents && splicing && spoolFd < 0 && result.output.size() >= spoolAfter){//small outputs never pay for a memfd
+            spoolFd = memfd_create("job output", MFD_CLOEXEC);
+            splicing = spoolFd >= 0;
+        }
+        if(descriptors[0].revents && splicing && spoolFd >= 0 && (size_t)spooled + result.output.size() >= limits.keep && discard < 0){
+            discard = open("/dev/null", O_WRONLY | O_CLOEXEC);
+            splicing = discard >= 0;
+        }
+        if(descriptors[0].revents && splicing && spoolFd >= 0){//page references move from the pipe to the memfd, the bytes are never copied here
+            bool keeping = (size_t)spooled + result.output.size() < limits.keep;
+            size_t chunk = keeping ? std::min<size_t>(1 << 20, limits.keep - spooled - result.output.size()) : 1 << 20;
+            ssize_t n = splice(launched.output, nullptr, keeping ? spoolFd : discard, keeping ? &spooled : nullptr, chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if(n == 0)reading = false;
+            spliced = n >= 0 || errno == EAGAIN || errno == EINTR;
+            if(!spliced)splicing = false;//a kernel that can not splice into a memfd, the rest is read as usual
+        }
+#endif
+        if(descriptors[0].revents && !spliced){
+            ssize_t n = read(launched.output, buffer, sizeof(buffer));
+            if(n > 0)result.output.append(buffer, n);
+            else reading = false;
+        }
+        if(descriptors[1].revents & POLLIN)exited = reap(20);//the helper's report follows the exit closely
+    }
+    close(launched.output);
+    if(launched.pidfd >= 0)close(launched.pidfd);
+    if(control != nullptr)control->group = 0;
+#ifdef __linux__
+    if(discard >= 0)close(discard);
+    if(spoolFd >= 0)result.spool = std::make_shared<Spool>(spoolFd, spooled);
+    if(cycleCounter >= 0 || instructionCounter >= 0){//inherited counts of exited children are folded into these
+        result.cycles = readCounter(cycleCounter);
+        result.instructions = readCounter(instructionCounter);
+    }
+#endif
+    bool cpuLimit = (WIFSIGNALED(result.status) && WTERMSIG(result.status) == SIGXCPU) ||
+                    (WIFEXITED(result.status) && WEXITSTATUS(result.status) == 128 + SIGXCPU);//the shell reports a child killed by SIGXCPU this way
+    if(result.stopped.empty() && limits.cpuSeconds > 0 && cpuLimit)result.stopped = "cpu limit";
+    if(!result.stopped.empty())kill(-pid, SIGKILL);
+    return result;
+}
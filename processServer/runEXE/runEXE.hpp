@@ -2,9 +2,71 @@
 #define UTILS_HPP
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <sys/types.h>
+#include <sys/resource.h>
 
 // Runs a executable and get its standard output which is stored in a string and returned
+// The executable gets a process group of its own so a limit or a cancel stops everything it started:
+// SIGTERM to the group first, then SIGKILL once the grace time is up.
+// With useZygote the jobs are started by the launch helper instead of forking the caller, see zygote.hpp.
+// Linux: given an executable fd (a memfd the program was unpacked into) the job is started from it with fexecve, the command's
+// words are its arguments and there is no shell; the helper can only spawn by path, so these jobs are always forked.
 
-std::string runExecutableAndCaptureOutput(const std::string& command);
+class Zygote;
 
-#endif
\ No newline at end of file
+struct RunLimits{
+    double wallSeconds = 0;//0 is no limit
+    double cpuSeconds = 0;//per process in the group, enforced by the kernel through RLIMIT_CPU in whole seconds
+    std::chrono::milliseconds grace{1000};//between SIGTERM and SIGKILL
+    bool counters = false;//cycles and instructions through perf_event_open, only if countersAvailable
+    std::vector<int> cpus;//hardware threads the job is pinned to, empty runs it anywhere
+    int memoryNode = -1;//NUMA node the job's memory comes from, -1 keeps the kernel's default
+    bool bindMemory = false;//MPOL_BIND fails allocations the node can not satisfy, otherwise MPOL_PREFERRED spills to other nodes
+    bool spool = false;//Linux: output past the first 16KB is spliced from the pipe into a memfd and never copied through this process
+    size_t keep = SIZE_MAX;//with spool, bytes of output kept, the rest is spliced to /dev/null
+};
+
+class Spool{//job output in a memfd, mapped read only so it can be sent straight from the pages it was spliced into
+    public:
+        Spool(int fd, size_t size);//takes the fd
+        ~Spool();
+        Spool(const Spool&) = delete;
+        Spool& operator=(const Spool&) = delete;
+        std::string_view data() const{ return {mapped, length}; }
+        size_t size() const{ return length; }
+
+    private:
+        int fd;
+        char* mapped = nullptr;
+        size_t length;
+};
+
+struct RunControl{//shared with the thread that may cancel the run
+    std::atomic<pid_t> group = 0;
+    std::atomic<bool> cancelled = false;
+};
+
+struct RunResult{
+    std::string output;//with a spool, only what came before it
+    int status = 0;//as returned by waitpid
+    std::string stopped;//why the job was killed, empty if it ended by itself
+    rusage usage = {};//from wait4, covers the shell and every process it waited for
+    long long cycles = -1;//-1 when not counted
+    long long instructions = -1;
+    std::shared_ptr<Spool> spool;//the rest of the output when limits.spool was on and there was enough to spool
+};
+
+RunResult runCommand(const std::string& command, const RunLimits& limits, RunControl* control = nullptr, int executable = -1);
+void cancelRun(RunControl& control);//safe from any thread, the run returns within the grace time
+bool countersAvailable();//false outside Linux, in most containers, and with perf_event_paranoid above 2
+void placeProcess(const RunLimits& limits);//pins the calling process to limits.cpus and memoryNode, Linux only
+void useZygote(Zygote* zygote);//nullptr goes back to forking, a helper that dies is also fallen back from
+std::string runCommandAndGetOutput(std::string command);
+
+#endif
@@ -0,0 +1,279 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <spawn.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+#include "zygote.hpp"
+
+//by Robert Britton
+
+extern char** environ;
+
+struct Request{//followed by cpuCount ints of cpus and then the command
+    uint64_t id;
+    double cpuSeconds;
+    int memoryNode;
+    bool bindMemory;
+    uint32_t cpuCount;
+};
+
+struct Message{//L answers a request, X reports a reaped job, both programs are the same binary so it goes over as is
+    char kind;
+    uint64_t id;
+    pid_t pid;
+    int status;
+    rusage usage;
+};
+
+#ifdef __linux__
+constexpr int socketType = SOCK_SEQPACKET;//the server closing its end reads as end of file
+#else
+constexpr int socketType = SOCK_DGRAM;//no SEQPACKET for Unix sockets on macOS, the helper watches getppid instead
+#endif
+
+int wakeFds[2] = {-1, -1};
+
+void childExited(int){
+    int saved = errno;
+    ssize_t ignored = write(wakeFds[1], "x", 1);
+    (void)ignored;
+    errno = saved;
+}
+
+bool sendMessage(int fd, const Message& message, const int* fds, size_t count){
+    iovec vector = {(void*)&message, sizeof(message)};
+    msghdr header = {};
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+    char control[CMSG_SPACE(2 * sizeof(int))] = {};
+    if(count > 0){
+        header.msg_control = control;
+        header.msg_controllen = CMSG_SPACE(count * sizeof(int));
+        cmsghdr* rights = CMSG_FIRSTHDR(&header);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(count * sizeof(int));
+        memcpy(CMSG_DATA(rights), fds, count * sizeof(int));
+    }
+    ssize_t n;
+    while((n = sendmsg(fd, &header, 0)) < 0 && errno == EINTR);
+    return n == sizeof(message);
+}
+
+ssize_t receiveMessage(int fd, Message& message, int* fds){//fds gets up to two descriptors, -1 for the ones not sent
+    iovec vector = {&message, sizeof(message)};
+    msghdr header = {};
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(fd, &header, 0);
+    fds[0] = fds[1] = -1;
+    if(n <= 0)return n;
+    for(cmsghdr* rights = CMSG_FIRSTHDR(&header); rights != nullptr; rights = CMSG_NXTHDR(&header, rights)){
+        if(rights->cmsg_level != SOL_SOCKET || rights->cmsg_type != SCM_RIGHTS)continue;
+        size_t count = std::min<size_t>((rights->cmsg_len - CMSG_LEN(0)) / sizeof(int), 2);
+        memcpy(fds, CMSG_DATA(rights), count * sizeof(int));
+        for(size_t i = 0; i < count; i++)fcntl(fds[i], F_SETFD, FD_CLOEXEC);//jobs started by fork must not hold another job's pipe open
+    }
+    return n;
+}
+
+Zygote* Zygote::start(){
+    int fds[2];
+    if(socketpair(AF_UNIX, socketType, 0, fds) != 0)return nullptr;
+    pid_t pid = fork();
+    if(pid < 0){
+        close(fds[0]);
+        close(fds[1]);
+        return nullptr;
+    }
+    if(pid == 0){
+        close(fds[0]);
+        serve(fds[1]);
+        _exit(0);
+    }
+    close(fds[1]);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    Zygote* zygote = new Zygote(fds[0]);
+    zygote->helper = pid;
+    std::thread([zygote]{ zygote->receive(); }).detach();
+    return zygote;
+}
+
+void Zygote::serve(int fd){
+    for(int other = 3; other < 1024; other++){//nothing of the server's is kept open, only the standard streams
+        if(other != fd)close(other);
+    }
+    if(pipe(wakeFds) != 0)_exit(1);
+    for(int wake : wakeFds)fcntl(wake, F_SETFL, O_NONBLOCK);
+    for(int wake : wakeFds)fcntl(wake, F_SETFD, FD_CLOEXEC);
+    struct sigaction action = {};
+    action.sa_handler = childExited;
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &action, nullptr);
+
+    sigset_t none;
+    sigemptyset(&none);
+    sigset_t defaults;//whatever the server ignored or handled is reset for the jobs
+    sigemptyset(&defaults);
+    for(int signal : {SIGCHLD, SIGPIPE, SIGINT, SIGTERM, SIGHUP})sigaddset(&defaults, signal);
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setpgroup(&attributes, 0);//a group of its own so a limit or a cancel stops everything it started
+    posix_spawnattr_setsigmask(&attributes, &none);
+    posix_spawnattr_setsigdefault(&attributes, &defaults);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+#ifdef __linux__
+    cpu_set_t everywhere;//put back after each pinned spawn
+    sched_getaffinity(0, sizeof(everywhere), &everywhere);
+#endif
+
+    pid_t parent = getppid();
+    std::vector<char> request(sizeof(Request) + 65536 + 4096 * sizeof(int));
+    while(true){
+        pollfd descriptors[2] = {{fd, POLLIN, 0}, {wakeFds[0], POLLIN, 0}};
+        poll(descriptors, 2, 1000);
+        if(getppid() != parent)_exit(0);//the server is gone, running jobs carry on under init
+        if(descriptors[1].revents & POLLIN){
+            char drain[64];
+            while(read(wakeFds[0], drain, sizeof(drain)) > 0);
+            Message exited{};
+            exited.kind = 'X';
+            while((exited.pid = wait4(-1, &exited.status, WNOHANG, &exited.usage)) > 0){
+                sendMessage(fd, exited, nullptr, 0);
+            }
+        }
+        if(!(descriptors[0].revents & (POLLIN | POLLHUP)))continue;
+        ssize_t n = recv(fd, request.data(), request.size(), 0);
+        if(n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN))_exit(0);
+        if(n < (ssize_t)sizeof(Request))continue;
+        Request header;
+        memcpy(&header, request.data(), sizeof(header));
+        size_t cpuBytes = header.cpuCount * sizeof(int);
+        if((size_t)n < sizeof(header) + cpuBytes)continue;
+        RunLimits placement;
+        placement.cpus.resize(header.cpuCount);
+        memcpy(placement.cpus.data(), request.data() + sizeof(header), cpuBytes);
+        placement.memoryNode = header.memoryNode;
+        placement.bindMemory = header.bindMemory;
+        std::string command(request.data() + sizeof(header) + cpuBytes, n - sizeof(header) - cpuBytes);
+        if(header.cpuSeconds > 0){//same limits the fork path sets with setrlimit, soft first since the hard limit may not go below it
+            long long seconds = (long long)std::ceil(header.cpuSeconds);
+            command = "ulimit -St " + std::to_string(seconds) + "; ulimit -Ht " + std::to_string(seconds + 1) + "; " + command;
+        }
+
+        Message launched{};
+        launched.kind = 'L';
+        launched.id = header.id;
+        launched.pid = -1;
+        int pipeFds[2];
+        if(pipe(pipeFds) != 0){
+            sendMessage(fd, launched, nullptr, 0);
+            continue;
+        }
+        fcntl(pipeFds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(pipeFds[1], F_SETFD, FD_CLOEXEC);//dup2 onto standard output clears it for the job
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, pipeFds[1], STDOUT_FILENO);
+        char* args[] = {(char*)"sh", (char*)"-c", command.data(), nullptr};
+        placeProcess(placement);//inherited by the job
+        if(posix_spawn(&launched.pid, "/bin/sh", &actions, &attributes, args, environ) != 0)launched.pid = -1;
+        posix_spawn_file_actions_destroy(&actions);
+#ifdef __linux__
+        if(!placement.cpus.empty())sched_setaffinity(0, sizeof(everywhere), &everywhere);
+        if(placement.memoryNode >= 0)syscall(SYS_set_mempolicy, 0, nullptr, 0);//MPOL_DEFAULT
+#endif
+        close(pipeFds[1]);
+        int fds[2] = {pipeFds[0], -1};
+#if defined(__linux__) && defined(SYS_pidfd_open)
+        if(launched.pid > 0)fds[1] = syscall(SYS_pidfd_open, launched.pid, 0);
+#endif
+        if(launched.pid > 0)sendMessage(fd, launched, fds, fds[1] >= 0 ? 2 : 1);
+        else sendMessage(fd, launched, nullptr, 0);
+        for(int open : fds){
+            if(open >= 0)close(open);
+        }
+    }
+}
+
+void Zygote::checkHelper(){//called with mtx held
+    if(alive && waitpid(helper, nullptr, WNOHANG) == helper){
+        alive = false;
+        std::cerr << "Launch helper exited, starting jobs with fork" << std::endl;
+    }
+}
+
+void Zygote::receive(){
+    while(true){
+        Message message;
+        int fds[2];
+        ssize_t n = receiveMessage(fd, message, fds);
+        if(n < 0 && errno == EINTR)continue;
+        std::lock_guard<std::mutex> lock(mtx);
+        if(n <= 0){
+            alive = false;
+            cv.notify_all();
+            return;
+        }
+        if(n != sizeof(message))continue;
+        if(message.kind == 'L')launches[message.id] = {message.pid, fds[0], fds[1]};
+        else exits[message.pid] = {message.status, message.usage};
+        cv.notify_all();
+    }
+}
+
+bool Zygote::launch(const std::string& command, const RunLimits& limits, Launch& launched){
+    std::unique_lock<std::mutex> lock(mtx);
+    if(!alive)return false;
+    Request header = {nextRequest++, limits.cpuSeconds, limits.memoryNode, limits.bindMemory, (uint32_t)std::min<size_t>(limits.cpus.size(), 4096)};
+    lock.unlock();//the helper may be blocked sending to the receive thread, which needs the lock
+    size_t cpuBytes = header.cpuCount * sizeof(int);
+    std::vector<char> request(sizeof(header) + cpuBytes + command.size());
+    memcpy(request.data(), &header, sizeof(header));
+    memcpy(request.data() + sizeof(header), limits.cpus.data(), cpuBytes);
+    memcpy(request.data() + sizeof(header) + cpuBytes, command.data(), command.size());
+    ssize_t n;
+    while((n = send(fd, request.data(), request.size(), 0)) < 0 && errno == EINTR);
+    lock.lock();
+    if(n != (ssize_t)request.size())return false;
+    while(alive && !launches.count(header.id)){
+        if(!cv.wait_for(lock, std::chrono::seconds(1), [&]{ return !alive || launches.count(header.id); }))checkHelper();
+    }
+    auto answer = launches.find(header.id);
+    if(answer == launches.end())return false;
+    launched = answer->second;
+    launches.erase(answer);
+    return launched.pid > 0;
+}
+
+bool Zygote::exited(pid_t pid, int& status, rusage& usage, int milliseconds){
+    std::unique_lock<std::mutex> lock(mtx);
+    if(!cv.wait_for(lock, std::chrono::milliseconds(milliseconds), [&]{ return !alive || exits.count(pid); }))checkHelper();
+    auto exit = exits.find(pid);
+    if(exit == exits.end()){
+        if(alive)return false;
+        status = 0;//nobody is left to report it, the job is treated as done
+        usage = {};
+        return true;
+    }
+    status = exit->second.status;
+    usage = exit->second.usage;
+    exits.erase(exit);
+    return true;
+}
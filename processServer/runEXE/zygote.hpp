@@ -0,0 +1,52 @@
+#ifndef ZYGOTE_HPP
+#define ZYGOTE_HPP
+
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "runEXE.hpp"
+
+// Small helper process that starts jobs for the processServer so the server itself never forks.
+// It is forked once at startup, before the server has threads, sockets or buffers, so it stays small.
+// Launch requests go to it over a Unix socket pair and it posix_spawns /bin/sh -c in a new process group.
+// The read end of the job's output pipe and a pidfd (Linux 5.3+) come back over the socket.
+// The job's cpu and memory placement is applied to the helper itself around the spawn, since posix_spawn has no attribute for it.
+// Only a parent can reap, so the helper also waits for the jobs and sends back their exit status and rusage.
+
+struct Launch{
+    pid_t pid = -1;
+    int output = -1;//read end of the job's standard output
+    int pidfd = -1;//readable once the job has exited, -1 where pidfds are not available
+};
+
+class Zygote{
+    public:
+        static Zygote* start();//nullptr if the helper could not be started, call before starting any threads
+        bool launch(const std::string& command, const RunLimits& limits, Launch& launched);//false if the helper is gone or the spawn failed
+        bool exited(pid_t pid, int& status, rusage& usage, int milliseconds);//true once the helper has reaped pid, waits up to milliseconds for it
+
+    private:
+        struct Exit{
+            int status;
+            rusage usage;
+        };
+
+        int fd;
+        pid_t helper = -1;
+        bool alive = true;
+        uint64_t nextRequest = 0;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::unordered_map<uint64_t, Launch> launches;//answers by request, pid -1 when the spawn failed
+        std::unordered_map<pid_t, Exit> exits;
+
+        explicit Zygote(int fd): fd(fd) {}
+        void receive();
+        void checkHelper();
+        static void serve(int fd);
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include "slots.hpp"
+
+//by Robert Britton
+
+std::vector<int> parseCPUList(const std::string& list){
+    std::vector<int> cpus;
+    std::istringstream ranges(list);
+    std::string range;
+    while(std::getline(ranges, range, ',')){
+        if(range.empty() || !isdigit((unsigned char)range[0]))continue;
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for(int cpu = first; cpu <= last; cpu++)cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::string readLine(const std::string& path){//empty if the file is missing
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+Slots::Slots(){
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);//a container or taskset may hand us only part of the host
+    std::map<int, int> nodeOf;
+    std::error_code error;
+    for(auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)){
+        std::string name = entry.path().filename();
+        if(name.rfind("node", 0) != 0 || name.size() == 4 || !isdigit((unsigned char)name[4]))continue;
+        for(int cpu : parseCPUList(readLine(entry.path().string() + "/cpulist")))nodeOf[cpu] = std::stoi(name.substr(4));
+    }
+    std::map<std::pair<int, int>, size_t> coreIndex;//package and core id to slot
+    for(int cpu : parseCPUList(readLine("/sys/devices/system/cpu/online"))){
+        if(cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))continue;
+        std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        std::string package = readLine(topology + "physical_package_id");
+        std::string core = readLine(topology + "core_id");
+        std::pair<int, int> key = {package.empty() ? 0 : std::stoi(package), core.empty() ? cpu : std::stoi(core)};
+        auto slot = coreIndex.find(key);
+        if(slot == coreIndex.end()){
+            slot = coreIndex.emplace(key, coreList.size()).first;
+            coreList.push_back({nodeOf.count(cpu) ? nodeOf[cpu] : 0, {}});
+        }
+        coreList[slot->second].cpus.push_back(cpu);
+    }
+#endif
+    if(coreList.empty()){//not Linux, or sysfs is not mounted
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        for(unsigned i = 0; i < threads; i++)coreList.push_back({0, {}});
+    }
+    int nodeCount = 0;
+    for(Core& core : coreList)nodeCount = std::max(nodeCount, core.node + 1);
+    nodes.resize(nodeCount);
+    for(size_t i = 0; i < coreList.size(); i++)nodes[coreList[i].node].push_back(i);
+    nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [](auto& node){ return node.empty(); }), nodes.end());//gaps in node numbers, or nodes with only memory
+    busy.assign(coreList.size(), false);
+}
+
+std::string Slots::describe() const{
+    size_t threads = 0;
+    for(const Core& core : coreList)threads += std::max<size_t>(core.cpus.size(), 1);
+    std::string text = "cores=" + std::to_string(coreList.size()) + " threads=" + std::to_string(threads) + " nodes=";
+    for(size_t i = 0; i < nodes.size(); i++)text += (i > 0 ? "," : "") + std::to_string(nodes[i].size());
+    return text;
+}
+
+bool Slots::fit(const std::string& request, Placement& placement){//called with mtx held, takes the node with the fewest free cores that still fits
+    size_t largest = 0;
+    for(auto& node : nodes)largest = std::max(largest, node.size());
+    size_t wanted = 1;
+    if(request == "node")wanted = largest;
+    else if(!request.empty() && request != "core")wanted = std::clamp<size_t>(std::strtoull(request.c_str(), nullptr, 10), 1, largest);
+    std::vector<size_t>* best = nullptr;
+    size_t bestFree = 0;
+    for(auto& node : nodes){
+        size_t free = std::count_if(node.begin(), node.end(), [&](size_t core){ return !busy[core]; });
+        bool fits = request == "node" ? free == node.size() : free >= wanted;//a node request takes a whole node, even a smaller one
+        if(fits && (best == nullptr || free < bestFree)){
+            best = &node;
+            bestFree = free;
+        }
+    }
+    if(best == nullptr)return false;
+    if(request == "node")wanted = best->size();
+    for(size_t core : *best){
+        if(busy[core] || placement.cores.size() == wanted)continue;
+        busy[core] = true;
+        placement.cores.push_back(core);
+        placement.cpus.insert(placement.cpus.end(), coreList[core].cpus.begin(), coreList[core].cpus.end());
+    }
+    placement.node = coreList[placement.cores.front()].node;
+    return true;
+}
+
+Placement Slots::acquire(const std::string& request){
+    Placement placement;
+    std::unique_lock<std::mutex> lock(mtx);
+    uint64_t ticket = nextTicket++;
+    cv.wait(lock, [&]{ return ticket == serving && fit(request, placement); });
+    serving++;
+    cv.notify_all();
+    return placement;
+}
+
+void Slots::release(const Placement& placement){
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for(size_t core : placement.cores)busy[core] = false;
+    }
+    cv.notify_all();
+}
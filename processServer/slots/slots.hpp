@@ -0,0 +1,51 @@
+#ifndef SLOTS_HPP
+#define SLOTS_HPP
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+// CPU and NUMA topology of the host, read from sysfs, split into slots of one physical core each (every hardware thread of it).
+// Jobs take slots to run on and are pinned there, so concurrent jobs stop evicting each other from the same core's caches.
+// A job asks for a slot with a request:
+//   "" or "core"  one core
+//   "<n>"         n cores on one node, at most a whole node
+//   "node"        every core of one node
+// Requests are granted in the order they were made, so a whole-node job is not starved by a stream of single-core jobs.
+// Outside Linux every hardware thread counts as a core on one node and nothing is pinned.
+
+struct Placement{
+    std::vector<size_t> cores;//indexes of the slots held
+    std::vector<int> cpus;//hardware threads of those cores
+    int node = -1;
+};
+
+class Slots{
+    public:
+        Slots();//reads the topology, only the cpus this process may run on are used
+        std::string describe() const;//cores=<n> threads=<n> nodes=<cores on node 0>,<cores on node 1>,... as sent to the manager
+        size_t cores() const{ return coreList.size(); }
+        Placement acquire(const std::string& request);//blocks until the request fits
+        void release(const Placement& placement);
+
+    private:
+        struct Core{
+            int node;
+            std::vector<int> cpus;
+        };
+
+        std::vector<Core> coreList;
+        std::vector<std::vector<size_t>> nodes;//cores on each node
+        std::vector<bool> busy;
+        std::mutex mtx;
+        std::condition_variable cv;
+        uint64_t nextTicket = 0;
+        uint64_t serving = 0;
+
+        bool fit(const std::string& request, Placement& placement);
+};
+
+std::vector<int> parseCPUList(const std::string& list);//sysfs list format, "0-3,8,10-11"
+
+#endif